@@ -0,0 +1,617 @@
+#include "arrow.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Flatbuffers, just enough for Arrow's Schema, RecordBatch and Footer.
+ *
+ * Objects are laid out front to back: a table is written with room for its
+ * fields, then its children after it, and the table's offset fields are
+ * patched to point forward at them (flatbuffer offsets are unsigned). Each
+ * table's vtable goes right before it. */
+
+typedef struct Fb {
+  unsigned char *buf;
+  size_t len;
+  size_t cap;
+  int failed; // Out of memory, later writes are dropped
+} Fb;
+
+enum { FB_ABSENT = 0, FB_U8 = 1, FB_I16 = 2, FB_I32 = 4, FB_I64 = 8 };
+#define FB_OFFSET FB_I32
+
+static size_t fbReserve(Fb *fb, size_t n) {
+  if (fb->failed) {
+    return 0;
+  }
+  if (fb->len + n > fb->cap) {
+    size_t cap = fb->cap ? fb->cap : 256;
+    while (cap < fb->len + n) {
+      cap *= 2;
+    }
+    unsigned char *buf = realloc(fb->buf, cap);
+    if (buf == NULL) {
+      fb->failed = 1;
+      return 0;
+    }
+    fb->buf = buf;
+    fb->cap = cap;
+  }
+  size_t pos = fb->len;
+  memset(fb->buf + pos, 0, n);
+  fb->len += n;
+  return pos;
+}
+
+static void fbAlign(Fb *fb, size_t align) {
+  size_t pad = (align - fb->len % align) % align;
+  fbReserve(fb, pad);
+}
+
+static void fbPut(Fb *fb, size_t pos, const void *value, size_t size) {
+  if (!fb->failed) {
+    memcpy(fb->buf + pos, value, size);
+  }
+}
+
+static void fbPut8(Fb *fb, size_t pos, uint8_t v) { fbPut(fb, pos, &v, 1); }
+static void fbPut16(Fb *fb, size_t pos, int16_t v) { fbPut(fb, pos, &v, 2); }
+static void fbPut32(Fb *fb, size_t pos, int32_t v) { fbPut(fb, pos, &v, 4); }
+static void fbPut64(Fb *fb, size_t pos, int64_t v) { fbPut(fb, pos, &v, 8); }
+
+/* Point the offset field at pos to target, which must come after it */
+static void fbLink(Fb *fb, size_t pos, size_t target) {
+  fbPut32(fb, pos, (int32_t)(target - pos));
+}
+
+/* Write a vtable and a table with the given field sizes (FB_ABSENT to skip
+ * one) and return each field's position in pos[] */
+static size_t fbTable(Fb *fb, int n, const int *sizes, size_t *pos) {
+  uint16_t offsets[16];
+  uint16_t size = 4; // soffset to the vtable
+
+  for (int i = 0; i < n; i++) {
+    if (sizes[i] == FB_ABSENT) {
+      offsets[i] = 0;
+      continue;
+    }
+    size = (size + sizes[i] - 1) / sizes[i] * sizes[i];
+    offsets[i] = size;
+    size += sizes[i];
+  }
+
+  fbAlign(fb, 2);
+  size_t vtable = fbReserve(fb, 4 + 2 * n);
+  fbPut16(fb, vtable, 4 + 2 * n);
+  fbPut16(fb, vtable + 2, size);
+  for (int i = 0; i < n; i++) {
+    fbPut16(fb, vtable + 4 + 2 * i, offsets[i]);
+  }
+
+  fbAlign(fb, 8);
+  size_t table = fbReserve(fb, size);
+  fbPut32(fb, table, (int32_t)(table - vtable));
+  for (int i = 0; i < n; i++) {
+    pos[i] = table + offsets[i];
+  }
+  return table;
+}
+
+/* Vector of count elements of elem_size bytes, aligned to align */
+static size_t fbVector(Fb *fb, size_t count, size_t elem_size, size_t align) {
+  fbReserve(fb, (align - (fb->len + 4) % align) % align);
+  size_t vec = fbReserve(fb, 4 + count * elem_size);
+  fbPut32(fb, vec, (int32_t)count);
+  return vec;
+}
+
+static size_t fbString(Fb *fb, const char *s) {
+  size_t n = strlen(s);
+  fbAlign(fb, 4);
+  size_t str = fbReserve(fb, 4 + n + 1);
+  fbPut32(fb, str, (int32_t)n);
+  fbPut(fb, str + 4, s, n);
+  return str;
+}
+
+/* Arrow format constants (Schema.fbs, Message.fbs) */
+#define METADATA_V5 4
+#define HEADER_SCHEMA 1
+#define HEADER_RECORD_BATCH 3
+#define TYPE_INT 2
+#define TYPE_FLOATING_POINT 3
+#define PRECISION_DOUBLE 2
+
+static void writeField(Fb *fb, size_t slot, const char *name, ArrowType type) {
+  /* Field { name, nullable, type_type, type, dictionary, children } */
+  int sizes[] = {FB_OFFSET, FB_U8, FB_U8, FB_OFFSET, FB_ABSENT, FB_OFFSET};
+  size_t pos[6];
+  size_t table = fbTable(fb, 6, sizes, pos);
+  fbLink(fb, slot, table);
+
+  fbLink(fb, pos[0], fbString(fb, name));
+  fbPut8(fb, pos[1], 0);
+
+  size_t type_pos;
+  if (type == ARROW_FLOAT64) {
+    fbPut8(fb, pos[2], TYPE_FLOATING_POINT);
+    int type_sizes[] = {FB_I16};
+    fbLink(fb, pos[3], fbTable(fb, 1, type_sizes, &type_pos));
+    fbPut16(fb, type_pos, PRECISION_DOUBLE);
+  } else {
+    fbPut8(fb, pos[2], TYPE_INT);
+    int type_sizes[] = {FB_I32, FB_U8};
+    size_t int_pos[2];
+    fbLink(fb, pos[3], fbTable(fb, 2, type_sizes, int_pos));
+    fbPut32(fb, int_pos[0], 64);
+    fbPut8(fb, int_pos[1], 1);
+  }
+
+  fbLink(fb, pos[5], fbVector(fb, 0, 4, 4));
+}
+
+static void writeSchema(Fb *fb, size_t slot, const ArrowWriter *w) {
+  /* Schema { endianness, fields } */
+  int sizes[] = {FB_I16, FB_OFFSET};
+  size_t pos[2];
+  fbLink(fb, slot, fbTable(fb, 2, sizes, pos));
+  fbPut16(fb, pos[0], 0);
+
+  size_t fields = fbVector(fb, w->n_cols, 4, 4);
+  fbLink(fb, pos[1], fields);
+  for (int i = 0; i < w->n_cols; i++) {
+    writeField(fb, fields + 4 + 4 * i, w->names[i], w->types[i]);
+  }
+}
+
+static int64_t pad8(int64_t n) { return (n + 7) & ~(int64_t)7; }
+
+/* Body buffers start 64-byte aligned, as the format recommends */
+static int64_t pad64(int64_t n) { return (n + 63) & ~(int64_t)63; }
+
+static int writeZeros(ArrowWriter *w, int64_t n) {
+  static const char zeros[64];
+  while (n > 0) {
+    int64_t chunk = n < 64 ? n : 64;
+    if (fwrite(zeros, 1, chunk, w->f) != (size_t)chunk) {
+      return 1;
+    }
+    w->offset += chunk;
+    n -= chunk;
+  }
+  return 0;
+}
+
+/* Encapsulated message: continuation marker, metadata length, flatbuffer
+ * padded to 8, then the body */
+static int writeMessage(ArrowWriter *w, Fb *fb, int32_t *metadata_length) {
+  int32_t size = (int32_t)pad8(fb->len);
+  uint32_t prefix[2] = {0xFFFFFFFFu, (uint32_t)size};
+
+  if (fb->failed || fwrite(prefix, 4, 2, w->f) != 2 ||
+      fwrite(fb->buf, 1, fb->len, w->f) != fb->len) {
+    return 1;
+  }
+  w->offset += 8 + fb->len;
+  if (metadata_length) {
+    *metadata_length = 8 + size;
+  }
+  return writeZeros(w, size - fb->len);
+}
+
+/* Message { version, header_type, header, bodyLength } */
+static void startMessage(Fb *fb, int header_type, int64_t body_length,
+                         size_t *header_slot) {
+  size_t root = fbReserve(fb, 4);
+  int sizes[] = {FB_I16, FB_U8, FB_OFFSET, FB_I64};
+  size_t pos[4];
+  fbLink(fb, root, fbTable(fb, 4, sizes, pos));
+  fbPut16(fb, pos[0], METADATA_V5);
+  fbPut8(fb, pos[1], header_type);
+  fbPut64(fb, pos[3], body_length);
+  *header_slot = pos[2];
+}
+
+ArrowWriter *arrowOpen(const char *path, int n_cols, const char *const *names,
+                       const ArrowType *types) {
+  ArrowWriter *w = calloc(1, sizeof(ArrowWriter));
+  if (w == NULL) {
+    return NULL;
+  }
+  w->f = fopen(path, "wb");
+  if (w->f == NULL) {
+    free(w);
+    return NULL;
+  }
+  w->n_cols = n_cols;
+  w->names = names;
+  w->types = types;
+
+  fwrite("ARROW1\0\0", 1, 8, w->f);
+  w->offset = 8;
+
+  Fb fb = {0};
+  size_t header;
+  startMessage(&fb, HEADER_SCHEMA, 0, &header);
+  writeSchema(&fb, header, w);
+  int err = writeMessage(w, &fb, NULL);
+  free(fb.buf);
+
+  if (err) {
+    fclose(w->f);
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+int arrowWriteBatch(ArrowWriter *w, int64_t rows, const void *const *columns) {
+  int64_t column_bytes = rows * 8;
+  int64_t stride = pad64(column_bytes);
+  int64_t body_length = stride * w->n_cols;
+
+  /* RecordBatch { length, nodes, buffers } */
+  Fb fb = {0};
+  size_t header;
+  startMessage(&fb, HEADER_RECORD_BATCH, body_length, &header);
+
+  int sizes[] = {FB_I64, FB_OFFSET, FB_OFFSET};
+  size_t pos[3];
+  fbLink(&fb, header, fbTable(&fb, 3, sizes, pos));
+  fbPut64(&fb, pos[0], rows);
+
+  /* FieldNode { length, null_count } per column */
+  size_t nodes = fbVector(&fb, w->n_cols, 16, 8);
+  fbLink(&fb, pos[1], nodes);
+  for (int i = 0; i < w->n_cols; i++) {
+    fbPut64(&fb, nodes + 4 + 16 * i, rows);
+    fbPut64(&fb, nodes + 4 + 16 * i + 8, 0);
+  }
+
+  /* Buffer { offset, length }: an empty validity bitmap, then the data */
+  size_t buffers = fbVector(&fb, 2 * w->n_cols, 16, 8);
+  fbLink(&fb, pos[2], buffers);
+  for (int i = 0; i < w->n_cols; i++) {
+    size_t b = buffers + 4 + 32 * i;
+    fbPut64(&fb, b, i * stride);
+    fbPut64(&fb, b + 8, 0);
+    fbPut64(&fb, b + 16, i * stride);
+    fbPut64(&fb, b + 24, column_bytes);
+  }
+
+  if (fb.failed) {
+    free(fb.buf);
+    return 1;
+  }
+  if (w->n_blocks == w->cap_blocks) {
+    int cap = w->cap_blocks ? 2 * w->cap_blocks : 16;
+    ArrowBlock *blocks = realloc(w->blocks, cap * sizeof(ArrowBlock));
+    if (blocks == NULL) {
+      free(fb.buf);
+      return 1;
+    }
+    w->blocks = blocks;
+    w->cap_blocks = cap;
+  }
+  ArrowBlock *block = &w->blocks[w->n_blocks++];
+  block->offset = w->offset;
+  block->body_length = body_length;
+
+  int err = writeMessage(w, &fb, &block->metadata_length);
+  free(fb.buf);
+
+  for (int i = 0; i < w->n_cols && !err; i++) {
+    if (fwrite(columns[i], 1, column_bytes, w->f) != (size_t)column_bytes) {
+      return 1;
+    }
+    w->offset += column_bytes;
+    err = writeZeros(w, stride - column_bytes);
+  }
+  return err;
+}
+
+int arrowClose(ArrowWriter *w) {
+  /* End-of-stream marker */
+  uint32_t eos[2] = {0xFFFFFFFFu, 0};
+  int err = fwrite(eos, 4, 2, w->f) != 2;
+
+  /* Footer { version, schema, dictionaries, recordBatches } */
+  Fb fb = {0};
+  size_t root = fbReserve(&fb, 4);
+  int sizes[] = {FB_I16, FB_OFFSET, FB_OFFSET, FB_OFFSET};
+  size_t pos[4];
+  fbLink(&fb, root, fbTable(&fb, 4, sizes, pos));
+  fbPut16(&fb, pos[0], METADATA_V5);
+  writeSchema(&fb, pos[1], w);
+  fbLink(&fb, pos[2], fbVector(&fb, 0, 24, 8));
+
+  /* Block { offset: long, metaDataLength: int, (pad), bodyLength: long } */
+  size_t blocks = fbVector(&fb, w->n_blocks, 24, 8);
+  fbLink(&fb, pos[3], blocks);
+  for (int i = 0; i < w->n_blocks; i++) {
+    size_t b = blocks + 4 + 24 * i;
+    fbPut64(&fb, b, w->blocks[i].offset);
+    fbPut32(&fb, b + 8, w->blocks[i].metadata_length);
+    fbPut64(&fb, b + 16, w->blocks[i].body_length);
+  }
+
+  int32_t footer_length = (int32_t)fb.len;
+  err |= fb.failed || fwrite(fb.buf, 1, fb.len, w->f) != fb.len;
+  err |= fwrite(&footer_length, 4, 1, w->f) != 1;
+  err |= fwrite("ARROW1", 1, 6, w->f) != 6;
+  err |= fclose(w->f) != 0;
+
+  free(fb.buf);
+  free(w->blocks);
+  free(w);
+  return err;
+}
+
+/* Flatbuffer reading. pos values are offsets into a buffer of len bytes and
+ * every access is bounds checked, so a corrupt file gives an error rather
+ * than a crash. */
+
+typedef struct FbRead {
+  const unsigned char *buf;
+  size_t len;
+  int bad;
+} FbRead;
+
+static uint32_t fbGet32(FbRead *r, size_t pos) {
+  uint32_t v = 0;
+  if (pos + 4 <= r->len) {
+    memcpy(&v, r->buf + pos, 4);
+  } else {
+    r->bad = 1;
+  }
+  return v;
+}
+
+static int64_t fbGet64(FbRead *r, size_t pos) {
+  int64_t v = 0;
+  if (pos + 8 <= r->len) {
+    memcpy(&v, r->buf + pos, 8);
+  } else {
+    r->bad = 1;
+  }
+  return v;
+}
+
+static uint16_t fbGet16(FbRead *r, size_t pos) {
+  uint16_t v = 0;
+  if (pos + 2 <= r->len) {
+    memcpy(&v, r->buf + pos, 2);
+  } else {
+    r->bad = 1;
+  }
+  return v;
+}
+
+/* Position of field i of the table at table, 0 if absent */
+static size_t fbField(FbRead *r, size_t table, int i) {
+  size_t vtable = table - (int32_t)fbGet32(r, table);
+  if (vtable >= r->len) {
+    r->bad = 1;
+    return 0;
+  }
+  uint16_t vt_size = fbGet16(r, vtable);
+  if (4 + 2 * i >= vt_size) {
+    return 0;
+  }
+  uint16_t off = fbGet16(r, vtable + 4 + 2 * i);
+  return off ? table + off : 0;
+}
+
+static size_t fbDeref(FbRead *r, size_t pos) {
+  return pos ? pos + fbGet32(r, pos) : 0;
+}
+
+static int64_t fbFieldInt(FbRead *r, size_t table, int i, int size) {
+  size_t pos = fbField(r, table, i);
+  if (!pos) {
+    return 0;
+  }
+  if (size == 1) {
+    return pos < r->len ? r->buf[pos] : (r->bad = 1, 0);
+  }
+  if (size == 2) {
+    return (int16_t)fbGet16(r, pos);
+  }
+  if (size == 4) {
+    return (int32_t)fbGet32(r, pos);
+  }
+  return fbGet64(r, pos);
+}
+
+static int readSchema(ArrowFile *f, FbRead *r, size_t schema) {
+  size_t fields = fbDeref(r, fbField(r, schema, 1));
+  if (!fields) {
+    return 1;
+  }
+
+  uint32_t n_cols = fbGet32(r, fields);
+  if (n_cols > ARROW_MAX_COLS) {
+    return 1;
+  }
+  f->n_cols = n_cols;
+
+  for (int i = 0; i < f->n_cols; i++) {
+    size_t field = fbDeref(r, fields + 4 + 4 * i);
+    size_t name = fbDeref(r, fbField(r, field, 0));
+    uint32_t name_len = fbGet32(r, name);
+    if (r->bad || name + 4 + name_len > r->len) {
+      return 1;
+    }
+    f->names[i] = strndup((const char *)r->buf + name + 4, name_len);
+
+    int type_type = fbFieldInt(r, field, 2, 1);
+    size_t type = fbDeref(r, fbField(r, field, 3));
+    if (type_type == TYPE_FLOATING_POINT &&
+        fbFieldInt(r, type, 0, 2) == PRECISION_DOUBLE) {
+      f->types[i] = ARROW_FLOAT64;
+    } else if (type_type == TYPE_INT && fbFieldInt(r, type, 0, 4) == 64) {
+      f->types[i] = ARROW_INT64;
+    } else {
+      return 1;
+    }
+  }
+  return r->bad;
+}
+
+static int readBatch(ArrowFile *f, int64_t offset, int64_t metadata_length,
+                     ArrowBatch *batch) {
+  /* Both come from the footer, so check them before adding anything */
+  int64_t size = f->size;
+  if (offset < 0 || metadata_length < 8 || offset > size ||
+      metadata_length > size - offset) {
+    return 1;
+  }
+
+  /* Skip the continuation marker and length prefix */
+  FbRead r = {.buf = f->map + offset + 8, .len = metadata_length - 8};
+  size_t message = fbGet32(&r, 0);
+  if (fbFieldInt(&r, message, 1, 1) != HEADER_RECORD_BATCH) {
+    return 1;
+  }
+  int64_t body_length = fbFieldInt(&r, message, 3, 8);
+  size_t rb = fbDeref(&r, fbField(&r, message, 2));
+
+  /* Compressed bodies aren't supported */
+  if (fbField(&r, rb, 3)) {
+    return 1;
+  }
+
+  batch->rows = fbFieldInt(&r, rb, 0, 8);
+  batch->body = f->map + offset + metadata_length;
+  if (body_length < 0 || body_length > size - offset - metadata_length ||
+      batch->rows < 0 || (f->n_cols && batch->rows > body_length / 8)) {
+    return 1;
+  }
+
+  /* Validity bitmaps are never read, so every value has to be present */
+  size_t nodes = fbDeref(&r, fbField(&r, rb, 1));
+  if ((int)fbGet32(&r, nodes) != f->n_cols) {
+    return 1;
+  }
+  for (int i = 0; i < f->n_cols; i++) {
+    if (fbGet64(&r, nodes + 4 + 16 * i + 8) != 0) {
+      return 1;
+    }
+  }
+
+  size_t buffers = fbDeref(&r, fbField(&r, rb, 2));
+  if ((int)fbGet32(&r, buffers) != 2 * f->n_cols) {
+    return 1;
+  }
+  for (int i = 0; i < f->n_cols; i++) {
+    size_t b = buffers + 4 + 32 * i + 16;
+    int64_t data_offset = fbGet64(&r, b);
+    int64_t data_length = fbGet64(&r, b + 8);
+    if (data_offset < 0 || data_offset > body_length ||
+        data_length < batch->rows * 8 ||
+        data_length > body_length - data_offset || data_offset % 8) {
+      return 1;
+    }
+    batch->data_offset[i] = data_offset;
+  }
+  return r.bad;
+}
+
+ArrowFile *arrowMap(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 24) {
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  ArrowFile *f = calloc(1, sizeof(ArrowFile));
+  if (f == NULL) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  f->map = map;
+  f->size = st.st_size;
+
+  /* Trailer: footer flatbuffer, its int32 length, "ARROW1" */
+  int32_t footer_length;
+  memcpy(&footer_length, f->map + f->size - 10, 4);
+  if (memcmp(f->map, "ARROW1", 6) ||
+      memcmp(f->map + f->size - 6, "ARROW1", 6) || footer_length <= 0 ||
+      (size_t)footer_length > f->size - 18) {
+    arrowUnmap(f);
+    return NULL;
+  }
+
+  FbRead r = {.buf = f->map + f->size - 10 - footer_length,
+              .len = footer_length};
+  size_t footer = fbGet32(&r, 0);
+  size_t schema = fbDeref(&r, fbField(&r, footer, 1));
+  size_t blocks = fbDeref(&r, fbField(&r, footer, 3));
+
+  if (!schema || !blocks || readSchema(f, &r, schema)) {
+    arrowUnmap(f);
+    return NULL;
+  }
+
+  /* Each 24 byte block has to be inside the footer */
+  uint32_t n_batches = fbGet32(&r, blocks);
+  if (r.bad || n_batches > (r.len - blocks - 4) / 24) {
+    arrowUnmap(f);
+    return NULL;
+  }
+  f->n_batches = n_batches;
+  f->batches = calloc(n_batches ? n_batches : 1, sizeof(ArrowBatch));
+  if (f->batches == NULL) {
+    arrowUnmap(f);
+    return NULL;
+  }
+  for (int i = 0; i < f->n_batches; i++) {
+    size_t b = blocks + 4 + 24 * i;
+    ArrowBatch *batch = &f->batches[i];
+    if (r.bad || readBatch(f, fbGet64(&r, b), (int32_t)fbGet32(&r, b + 8),
+                           batch)) {
+      arrowUnmap(f);
+      return NULL;
+    }
+    batch->first_row = f->rows;
+    f->rows += batch->rows;
+  }
+
+  return f;
+}
+
+void arrowUnmap(ArrowFile *f) {
+  if (f == NULL) {
+    return;
+  }
+  munmap((void *)f->map, f->size);
+  for (int i = 0; i < f->n_cols; i++) {
+    free(f->names[i]);
+  }
+  free(f->batches);
+  free(f);
+}
+
+int arrowColumnIndex(const ArrowFile *f, const char *name) {
+  for (int i = 0; i < f->n_cols; i++) {
+    if (!strcmp(f->names[i], name)) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,75 @@
+#ifndef ARROW_H
+#define ARROW_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Minimal writer for the Arrow IPC file format (Feather v2): one schema of
+ * non-nullable primitive columns followed by any number of record batches.
+ * Column data is written straight from the caller's arrays, and the file can
+ * be memory-mapped by pyarrow/polars without parsing. */
+
+typedef enum ArrowType { ARROW_FLOAT64, ARROW_INT64 } ArrowType;
+
+typedef struct ArrowBlock {
+  int64_t offset;
+  int32_t metadata_length;
+  int64_t body_length;
+} ArrowBlock;
+
+typedef struct ArrowWriter {
+  FILE *f;
+  int64_t offset;
+  int n_cols;
+  const char *const *names;
+  const ArrowType *types;
+  ArrowBlock *blocks;
+  int n_blocks;
+  int cap_blocks;
+} ArrowWriter;
+
+/* names and types must outlive the writer */
+ArrowWriter *arrowOpen(const char *path, int n_cols, const char *const *names,
+                       const ArrowType *types);
+
+/* Append rows from one array per column */
+int arrowWriteBatch(ArrowWriter *w, int64_t rows, const void *const *columns);
+
+/* Write the footer and close the file */
+int arrowClose(ArrowWriter *w);
+
+/* Read side: memory-map an Arrow IPC file of non-nullable, uncompressed
+ * 64-bit columns (what ArrowWriter produces) and hand out pointers straight
+ * into the mapping */
+
+#define ARROW_MAX_COLS 32
+
+typedef struct ArrowBatch {
+  int64_t rows;
+  int64_t first_row;
+  const unsigned char *body;
+  int64_t data_offset[ARROW_MAX_COLS];
+} ArrowBatch;
+
+typedef struct ArrowFile {
+  const unsigned char *map;
+  size_t size;
+  int n_cols;
+  char *names[ARROW_MAX_COLS];
+  ArrowType types[ARROW_MAX_COLS];
+  ArrowBatch *batches;
+  int n_batches;
+  int64_t rows;
+} ArrowFile;
+
+ArrowFile *arrowMap(const char *path);
+void arrowUnmap(ArrowFile *f);
+
+/* Index of the named column, -1 if missing */
+int arrowColumnIndex(const ArrowFile *f, const char *name);
+
+static inline const void *arrowColumn(const ArrowFile *f, int batch, int col) {
+  return f->batches[batch].body + f->batches[batch].data_offset[col];
+}
+
+#endif
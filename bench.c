@@ -0,0 +1,112 @@
+#define _GNU_SOURCE
+#include "bench.h"
+#include "clock.h"
+#include "energy.h"
+#include "ensemble.h"
+#include "metrics.h"
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCALAR_BATCH 1000 // Scalar steps between clock reads
+
+typedef struct Bench {
+  Ensemble e;
+  Pool *pool;
+  Body a, b;
+  uint64_t step;
+} Bench;
+
+/* Each advances by one batch and returns the pendulum steps it took */
+static double rk4(Bench *bench) {
+  ensembleStep(&bench->e, bench->pool, DT);
+  return bench->e.n;
+}
+
+static double langevin(Bench *bench) {
+  ensembleLangevin(&bench->e, bench->pool, DT, 1, bench->step++);
+  return bench->e.n;
+}
+
+static double scalar(Bench *bench) {
+  for (int s = 0; s < SCALAR_BATCH; s++) {
+    updatePositions(&bench->a, &bench->b);
+  }
+  metricsAdd(COUNTER_STEPS, SCALAR_BATCH);
+  metricsAdd(COUNTER_LAGRANGE, 4 * SCALAR_BATCH);
+  return SCALAR_BATCH;
+}
+
+static const struct {
+  const char *name;
+  double (*batch)(Bench *bench);
+} workloads[] = {
+    {"rk4", rk4},
+    {"langevin", langevin},
+    {"scalar", scalar},
+};
+
+/* double-pendulum --bench [--lanes N] [--seconds T] [--threads T]
+ *
+ * Runs each integrator for about T seconds and prints pendulum steps per
+ * second. Where the RAPL counters can be read it also prints the package
+ * energy per step and per simulated second of one pendulum, which covers
+ * everything else the machine did meanwhile too. */
+int benchMain(int argc, char **argv) {
+  size_t lanes = 65536;
+  double seconds = 2.0;
+  int threads = 0;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--lanes") && i + 1 < argc) {
+      lanes = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    }
+  }
+
+  Bench bench = {.a = {.l = 1.0, .m = 1.0, .t = 1.8},
+                 .b = {.l = 1.0, .m = 1.0, .t = 1.0}};
+  bench.pool = poolCreate(threads);
+  if (bench.pool == NULL ||
+      ensembleInit(&bench.e, lanes, &bench.a, &bench.b) != 0) {
+    printf("Could not allocate %zu lanes\n", lanes);
+    return 1;
+  }
+  bench.e.gamma = 0.5;
+  bench.e.kT = 1.0;
+
+  EnergyMeter meter;
+  if (energyOpen(&meter) == 0) {
+    printf("No readable RAPL counters under /sys/class/powercap, "
+           "timing only\n");
+  }
+
+  printf("%-10s %14s %12s %14s\n", "workload", "steps/s", "nJ/step",
+         "J/sim-second");
+  for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+    double steps = 0;
+    energyStart(&meter);
+    double start = nowSeconds(), elapsed;
+    do {
+      steps += workloads[w].batch(&bench);
+      elapsed = nowSeconds() - start;
+    } while (elapsed < seconds);
+    double joules = energyStop(&meter);
+
+    printf("%-10s %14.4g", workloads[w].name, steps / elapsed);
+    if (joules >= 0) {
+      printf(" %12.4g %14.4g\n", joules / steps * 1e9, joules / steps / DT);
+    } else {
+      printf(" %12s %14s\n", "-", "-");
+    }
+  }
+
+  ensembleFree(&bench.e);
+  poolDestroy(bench.pool);
+  return 0;
+}
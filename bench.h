@@ -0,0 +1,7 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* double-pendulum --bench: throughput and energy of each integrator */
+int benchMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,563 @@
+#include "boundary.h"
+#include "ensemble.h"
+#include "pool.h"
+#include "sweep.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH_LANES 65536 // Initial conditions integrated together
+
+enum { UNKNOWN, STAYS, FLIPS };
+
+/* Open addressing map from grid keys to values. Keys are stored plus one so
+ * that zero marks an empty slot. */
+typedef struct KeyMap {
+  uint64_t *keys;
+  uint64_t *vals;
+  size_t cap;
+  size_t count;
+} KeyMap;
+
+static uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+static int mapInit(KeyMap *m, size_t cap) {
+  m->cap = cap;
+  m->count = 0;
+  m->keys = calloc(cap, sizeof(uint64_t));
+  m->vals = calloc(cap, sizeof(uint64_t));
+  return m->keys == NULL || m->vals == NULL;
+}
+
+static void mapFree(KeyMap *m) {
+  free(m->keys);
+  free(m->vals);
+}
+
+static size_t mapSlot(const KeyMap *m, uint64_t key) {
+  size_t i = mix(key) & (m->cap - 1);
+  while (m->keys[i] && m->keys[i] != key + 1) {
+    i = (i + 1) & (m->cap - 1);
+  }
+  return i;
+}
+
+static uint64_t mapGet(const KeyMap *m, uint64_t key) {
+  size_t i = mapSlot(m, key);
+  return m->keys[i] ? m->vals[i] : 0;
+}
+
+/* Insert key with value val unless present. Returns 1 if it was added, 0 if
+ * it was already there and -1 if the map couldn't grow. */
+static int mapAdd(KeyMap *m, uint64_t key, uint64_t val) {
+  if (2 * (m->count + 1) > m->cap) {
+    KeyMap bigger;
+    if (mapInit(&bigger, 2 * m->cap)) {
+      mapFree(&bigger);
+      return -1;
+    }
+    for (size_t i = 0; i < m->cap; i++) {
+      if (m->keys[i]) {
+        size_t j = mapSlot(&bigger, m->keys[i] - 1);
+        bigger.keys[j] = m->keys[i];
+        bigger.vals[j] = m->vals[i];
+      }
+    }
+    bigger.count = m->count;
+    mapFree(m);
+    *m = bigger;
+  }
+
+  size_t i = mapSlot(m, key);
+  if (m->keys[i]) {
+    return 0;
+  }
+  m->keys[i] = key + 1;
+  m->vals[i] = val;
+  m->count++;
+  return 1;
+}
+
+static void mapSet(KeyMap *m, uint64_t key, uint64_t val) {
+  m->vals[mapSlot(m, key)] = val;
+}
+
+typedef struct KeyList {
+  uint64_t *keys;
+  size_t n, cap;
+} KeyList;
+
+static int listPush(KeyList *l, uint64_t key) {
+  if (l->n == l->cap) {
+    size_t cap = l->cap ? 2 * l->cap : 1024;
+    uint64_t *keys = realloc(l->keys, cap * sizeof(uint64_t));
+    if (keys == NULL) {
+      return 1;
+    }
+    l->keys = keys;
+    l->cap = cap;
+  }
+  l->keys[l->n++] = key;
+  return 0;
+}
+
+typedef struct Tracer {
+  const BoundaryConfig *cfg;
+  uint64_t n;    // Cells per side, so n + 1 grid points
+  double h;      // Grid spacing
+  double x0, y0; // Lower left grid point
+  Ensemble e;
+  Pool *pool;
+  double *flip_time;
+  size_t evaluations;
+  KeyMap corners; // Grid point -> STAYS or FLIPS
+  KeyMap cells;   // Cells already queued
+  KeyMap edges;   // Mixed edge -> index into the crossing arrays
+} Tracer;
+
+/* Integrate n initial conditions at rest and classify each as STAYS or
+ * FLIPS, BATCH_LANES at a time */
+static void classify(Tracer *t, const double *th1, const double *th2,
+                     size_t n, uint8_t *out) {
+  size_t cap = t->e.n;
+  for (size_t begin = 0; begin < n; begin += cap) {
+    size_t m = n - begin < cap ? n - begin : cap;
+    t->e.n = m;
+    for (size_t i = 0; i < m; i++) {
+      t->e.t1[i] = th1[begin + i];
+      t->e.t2[i] = th2[begin + i];
+      t->e.w1[i] = 0;
+      t->e.w2[i] = 0;
+    }
+    sweepFlipTimes(&t->e, t->pool, t->cfg->seconds, t->flip_time);
+    for (size_t i = 0; i < m; i++) {
+      out[begin + i] = t->flip_time[i] != 0 ? FLIPS : STAYS;
+    }
+    t->e.n = cap;
+  }
+  t->evaluations += n;
+}
+
+static uint64_t cornerKey(const Tracer *t, uint64_t i, uint64_t j) {
+  return i * (t->n + 1) + j;
+}
+
+static int corner(const Tracer *t, uint64_t i, uint64_t j) {
+  return mapGet(&t->corners, cornerKey(t, i, j));
+}
+
+/* Classify every grid point in points that hasn't been seen yet, in one
+ * batch */
+static int classifyCorners(Tracer *t, const KeyList *points) {
+  KeyList todo = {0};
+  for (size_t k = 0; k < points->n; k++) {
+    int added = mapAdd(&t->corners, points->keys[k], UNKNOWN);
+    if (added < 0 || (added && listPush(&todo, points->keys[k]))) {
+      free(todo.keys);
+      return 1;
+    }
+  }
+
+  double *th1 = malloc((todo.n + 1) * sizeof(double));
+  double *th2 = malloc((todo.n + 1) * sizeof(double));
+  uint8_t *cls = malloc(todo.n + 1);
+  if (!th1 || !th2 || !cls) {
+    free(th1);
+    free(th2);
+    free(cls);
+    free(todo.keys);
+    return 1;
+  }
+
+  for (size_t k = 0; k < todo.n; k++) {
+    th1[k] = t->x0 + (todo.keys[k] / (t->n + 1)) * t->h;
+    th2[k] = t->y0 + (todo.keys[k] % (t->n + 1)) * t->h;
+  }
+  classify(t, th1, th2, todo.n, cls);
+  for (size_t k = 0; k < todo.n; k++) {
+    mapSet(&t->corners, todo.keys[k], cls[k]);
+  }
+
+  free(th1);
+  free(th2);
+  free(cls);
+  free(todo.keys);
+  return 0;
+}
+
+/* Queue cell (i, j) unless it's outside the window or already queued */
+static int visit(Tracer *t, KeyList *next, int64_t i, int64_t j) {
+  if (i < 0 || j < 0 || (uint64_t)i >= t->n || (uint64_t)j >= t->n) {
+    return 0;
+  }
+  int added = mapAdd(&t->cells, i * t->n + j, 1);
+  return added < 0 || (added && listPush(next, i * t->n + j));
+}
+
+/* Flood along the boundary: a cell's neighbour across a mixed edge shares
+ * that edge, so it's on the boundary too. Every round classifies the new
+ * corners of the whole frontier in one batch. */
+static int trace(Tracer *t, KeyList *frontier, KeyList *boundary) {
+  KeyList points = {0}, next = {0};
+  int err = 0;
+
+  while (frontier->n > 0 && boundary->n < t->cfg->max_cells && !err) {
+    points.n = 0;
+    for (size_t k = 0; k < frontier->n && !err; k++) {
+      uint64_t i = frontier->keys[k] / t->n, j = frontier->keys[k] % t->n;
+      err |= listPush(&points, cornerKey(t, i, j));
+      err |= listPush(&points, cornerKey(t, i + 1, j));
+      err |= listPush(&points, cornerKey(t, i, j + 1));
+      err |= listPush(&points, cornerKey(t, i + 1, j + 1));
+    }
+    err = err || classifyCorners(t, &points);
+
+    next.n = 0;
+    for (size_t k = 0; k < frontier->n && !err; k++) {
+      int64_t i = frontier->keys[k] / t->n, j = frontier->keys[k] % t->n;
+      int c00 = corner(t, i, j), c10 = corner(t, i + 1, j);
+      int c01 = corner(t, i, j + 1), c11 = corner(t, i + 1, j + 1);
+      if (c00 == c10 && c10 == c01 && c01 == c11) {
+        continue;
+      }
+      err |= listPush(boundary, frontier->keys[k]);
+      if (c00 != c10) {
+        err |= visit(t, &next, i, j - 1);
+      }
+      if (c01 != c11) {
+        err |= visit(t, &next, i, j + 1);
+      }
+      if (c00 != c01) {
+        err |= visit(t, &next, i - 1, j);
+      }
+      if (c10 != c11) {
+        err |= visit(t, &next, i + 1, j);
+      }
+    }
+
+    KeyList swap = *frontier;
+    *frontier = next;
+    next = swap;
+  }
+
+  free(points.keys);
+  free(next.keys);
+  return err;
+}
+
+/* Edges are keyed by their lower left grid point and direction */
+enum { EDGE_THETA1, EDGE_THETA2 };
+
+static uint64_t edgeKey(const Tracer *t, uint64_t i, uint64_t j, int dir) {
+  return cornerKey(t, i, j) << 1 | dir;
+}
+
+typedef struct Crossings {
+  size_t n;
+  uint64_t *keys;
+  double *lo, *hi; // Bracket along the edge, as a fraction of h
+  double *th1, *th2;
+  uint8_t *start; // Class of the edge's lower left end
+  uint8_t *cls;
+} Crossings;
+
+static int addCrossing(Tracer *t, Crossings *c, uint64_t i, uint64_t j,
+                       int dir) {
+  int added = mapAdd(&t->edges, edgeKey(t, i, j, dir), c->n);
+  if (added <= 0) {
+    return added < 0;
+  }
+  c->keys[c->n] = edgeKey(t, i, j, dir);
+  c->start[c->n] = corner(t, i, j);
+  c->lo[c->n] = 0;
+  c->hi[c->n] = 1;
+  c->n++;
+  return 0;
+}
+
+static void crossingPoint(const Tracer *t, const Crossings *c, size_t k,
+                          double s, double *th1, double *th2) {
+  uint64_t point = c->keys[k] >> 1;
+  *th1 = t->x0 + (point / (t->n + 1)) * t->h;
+  *th2 = t->y0 + (point % (t->n + 1)) * t->h;
+  if ((c->keys[k] & 1) == EDGE_THETA1) {
+    *th1 += s * t->h;
+  } else {
+    *th2 += s * t->h;
+  }
+}
+
+/* Narrow every crossing together, one batch per halving, until the bracket
+ * is within the tolerance */
+static void bisect(Tracer *t, Crossings *c) {
+  int rounds = 0;
+  while (t->h / (1ull << rounds) > t->cfg->tolerance && rounds < 52) {
+    rounds++;
+  }
+
+  for (int r = 0; r < rounds; r++) {
+    for (size_t k = 0; k < c->n; k++) {
+      crossingPoint(t, c, k, (c->lo[k] + c->hi[k]) / 2, &c->th1[k],
+                    &c->th2[k]);
+    }
+    classify(t, c->th1, c->th2, c->n, c->cls);
+    for (size_t k = 0; k < c->n; k++) {
+      if (c->cls[k] == c->start[k]) {
+        c->lo[k] = (c->lo[k] + c->hi[k]) / 2;
+      } else {
+        c->hi[k] = (c->lo[k] + c->hi[k]) / 2;
+      }
+    }
+  }
+}
+
+static void segment(const Tracer *t, const Crossings *c, uint64_t e0,
+                    uint64_t e1, BoundarySegment *s) {
+  size_t k0 = mapGet(&t->edges, e0), k1 = mapGet(&t->edges, e1);
+  crossingPoint(t, c, k0, (c->lo[k0] + c->hi[k0]) / 2, &s->a1, &s->a2);
+  crossingPoint(t, c, k1, (c->lo[k1] + c->hi[k1]) / 2, &s->b1, &s->b2);
+}
+
+/* Marching squares over the boundary cells. Saddle cells are split so the
+ * flipping corners stay apart. */
+static size_t contour(const Tracer *t, const Crossings *c,
+                      const KeyList *boundary, BoundarySegment *out) {
+  size_t n = 0;
+  for (size_t k = 0; k < boundary->n; k++) {
+    uint64_t i = boundary->keys[k] / t->n, j = boundary->keys[k] % t->n;
+    int c00 = corner(t, i, j), c10 = corner(t, i + 1, j);
+    int c01 = corner(t, i, j + 1), c11 = corner(t, i + 1, j + 1);
+
+    uint64_t bottom = edgeKey(t, i, j, EDGE_THETA1);
+    uint64_t top = edgeKey(t, i, j + 1, EDGE_THETA1);
+    uint64_t left = edgeKey(t, i, j, EDGE_THETA2);
+    uint64_t right = edgeKey(t, i + 1, j, EDGE_THETA2);
+
+    uint64_t mixed[4];
+    int m = 0;
+    if (c00 != c10) {
+      mixed[m++] = bottom;
+    }
+    if (c10 != c11) {
+      mixed[m++] = right;
+    }
+    if (c01 != c11) {
+      mixed[m++] = top;
+    }
+    if (c00 != c01) {
+      mixed[m++] = left;
+    }
+
+    if (m == 2) {
+      segment(t, c, mixed[0], mixed[1], &out[n++]);
+    } else if (m == 4 && c00 == FLIPS) {
+      segment(t, c, left, bottom, &out[n++]);
+      segment(t, c, right, top, &out[n++]);
+    } else if (m == 4) {
+      segment(t, c, bottom, right, &out[n++]);
+      segment(t, c, top, left, &out[n++]);
+    }
+  }
+  return n;
+}
+
+int traceBoundary(const BoundaryConfig *cfg, BoundaryResult *result) {
+  memset(result, 0, sizeof(BoundaryResult));
+
+  Tracer t = {.cfg = cfg, .n = cfg->cells};
+  t.h = cfg->span / cfg->cells;
+  t.x0 = cfg->theta1 - cfg->span / 2;
+  t.y0 = cfg->theta2 - cfg->span / 2;
+
+  Body a = {.l = 1.0, .m = 1.0};
+  Body b = {.l = 1.0, .m = 1.0};
+  t.pool = poolCreate(cfg->threads);
+  t.flip_time = malloc(BATCH_LANES * sizeof(double));
+  KeyList frontier = {0}, boundary = {0}, points = {0};
+  Crossings c = {0};
+  int err = !t.pool || !t.flip_time ||
+            ensembleInit(&t.e, BATCH_LANES, &a, &b) != 0 ||
+            mapInit(&t.corners, 1 << 16) || mapInit(&t.cells, 1 << 16) ||
+            mapInit(&t.edges, 1 << 16);
+
+  /* Seed from every crossing along a lattice of grid rows and columns,
+   * so each part of the boundary that reaches across a gap between them
+   * gets traced */
+  uint64_t lines = cfg->seed_lines < cfg->cells ? cfg->seed_lines : cfg->cells;
+  for (uint64_t l = 0; l <= lines && !err; l++) {
+    uint64_t m = l * t.n / lines;
+    for (uint64_t i = 0; i <= t.n && !err; i++) {
+      err |= listPush(&points, cornerKey(&t, i, m));
+      err |= listPush(&points, cornerKey(&t, m, i));
+    }
+  }
+  err = err || classifyCorners(&t, &points);
+  for (uint64_t l = 0; l <= lines && !err; l++) {
+    uint64_t m = l * t.n / lines;
+    for (uint64_t i = 0; i < t.n && !err; i++) {
+      if (corner(&t, i, m) != corner(&t, i + 1, m)) {
+        err |= visit(&t, &frontier, i, m);
+        err |= visit(&t, &frontier, i, (int64_t)m - 1);
+      }
+      if (corner(&t, m, i) != corner(&t, m, i + 1)) {
+        err |= visit(&t, &frontier, m, i);
+        err |= visit(&t, &frontier, (int64_t)m - 1, i);
+      }
+    }
+  }
+
+  err = err || trace(&t, &frontier, &boundary);
+
+  /* Every boundary cell has at most four mixed edges, each shared */
+  size_t cap = 4 * boundary.n + 1;
+  c.keys = malloc(cap * sizeof(uint64_t));
+  c.lo = malloc(cap * sizeof(double));
+  c.hi = malloc(cap * sizeof(double));
+  c.th1 = malloc(cap * sizeof(double));
+  c.th2 = malloc(cap * sizeof(double));
+  c.start = malloc(cap);
+  c.cls = malloc(cap);
+  err = err || !c.keys || !c.lo || !c.hi || !c.th1 || !c.th2 || !c.start ||
+        !c.cls;
+
+  for (size_t k = 0; k < boundary.n && !err; k++) {
+    uint64_t i = boundary.keys[k] / t.n, j = boundary.keys[k] % t.n;
+    int c00 = corner(&t, i, j), c10 = corner(&t, i + 1, j);
+    int c01 = corner(&t, i, j + 1), c11 = corner(&t, i + 1, j + 1);
+    if (c00 != c10) {
+      err |= addCrossing(&t, &c, i, j, EDGE_THETA1);
+    }
+    if (c01 != c11) {
+      err |= addCrossing(&t, &c, i, j + 1, EDGE_THETA1);
+    }
+    if (c00 != c01) {
+      err |= addCrossing(&t, &c, i, j, EDGE_THETA2);
+    }
+    if (c10 != c11) {
+      err |= addCrossing(&t, &c, i + 1, j, EDGE_THETA2);
+    }
+  }
+
+  if (!err) {
+    bisect(&t, &c);
+    result->segments = malloc((2 * boundary.n + 1) * sizeof(BoundarySegment));
+    err = result->segments == NULL;
+  }
+  if (!err) {
+    result->n_segments = contour(&t, &c, &boundary, result->segments);
+    result->cells = boundary.n;
+    result->corners = t.corners.count;
+    result->evaluations = t.evaluations;
+  }
+
+  free(c.keys);
+  free(c.lo);
+  free(c.hi);
+  free(c.th1);
+  free(c.th2);
+  free(c.start);
+  free(c.cls);
+  free(frontier.keys);
+  free(boundary.keys);
+  free(points.keys);
+  mapFree(&t.corners);
+  mapFree(&t.cells);
+  mapFree(&t.edges);
+  ensembleFree(&t.e);
+  free(t.flip_time);
+  if (t.pool) {
+    poolDestroy(t.pool);
+  }
+  return err;
+}
+
+/* double-pendulum --boundary [--theta1 T1] [--theta2 T2] [--span S]
+ *     [--cells N] [--seconds T] [--tolerance E] [--max-cells M]
+ *     [--seed-lines L] [--threads T] [--output FILE]
+ *
+ * Writes the contour segments as CSV to stdout or --output. */
+int boundaryMain(int argc, char **argv) {
+  BoundaryConfig cfg = {.theta1 = 0,
+                        .theta2 = 0,
+                        .span = 2 * M_PI,
+                        .cells = 512,
+                        .seconds = 10.0,
+                        .tolerance = 1e-9,
+                        .max_cells = 1000000,
+                        .seed_lines = 16};
+  const char *output = NULL;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--theta1") && i + 1 < argc) {
+      cfg.theta1 = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--theta2") && i + 1 < argc) {
+      cfg.theta2 = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--span") && i + 1 < argc) {
+      cfg.span = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--cells") && i + 1 < argc) {
+      cfg.cells = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      cfg.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+      cfg.tolerance = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-cells") && i + 1 < argc) {
+      cfg.max_cells = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed-lines") && i + 1 < argc) {
+      cfg.seed_lines = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      cfg.threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+      output = argv[++i];
+    }
+  }
+
+  if (cfg.cells < 2 || cfg.span <= 0 || cfg.tolerance <= 0 ||
+      cfg.seed_lines < 1) {
+    printf("--cells must be at least 2, --span, --tolerance and --seed-lines "
+           "positive\n");
+    return 1;
+  }
+
+  BoundaryResult r;
+  if (traceBoundary(&cfg, &r)) {
+    printf("Boundary tracing failed\n");
+    return 1;
+  }
+
+  FILE *f = output ? fopen(output, "w") : stdout;
+  if (f == NULL) {
+    printf("Could not open %s\n", output);
+    free(r.segments);
+    return 1;
+  }
+  fprintf(f, "theta1_a,theta2_a,theta1_b,theta2_b\n");
+  for (size_t k = 0; k < r.n_segments; k++) {
+    const BoundarySegment *s = &r.segments[k];
+    fprintf(f, "%.17g,%.17g,%.17g,%.17g\n", s->a1, s->a2, s->b1, s->b2);
+  }
+  int err = ferror(f);
+  if (output) {
+    err |= fclose(f) != 0;
+    double grid = (double)(cfg.cells + 1) * (cfg.cells + 1);
+    printf("%zu segments through %zu of %.0f cells\n", r.n_segments, r.cells,
+           (double)cfg.cells * cfg.cells);
+    printf("%zu of %.0f grid points classified (%.3g%%), %zu pendulums "
+           "integrated with bisection\n",
+           r.corners, grid, 100.0 * r.corners / grid, r.evaluations);
+    printf("A grid at the %.3g rad tolerance would need %.3g\n",
+           cfg.tolerance, pow(cfg.span / cfg.tolerance, 2));
+  }
+  if (err) {
+    printf("Error writing the contour\n");
+  }
+
+  free(r.segments);
+  return err;
+}
@@ -0,0 +1,43 @@
+#ifndef BOUNDARY_H
+#define BOUNDARY_H
+
+#include <stddef.h>
+
+/* Contour of the flip-time boundary: the edge between starting angles that
+ * flip before T and those that don't, inside a square window. The window is
+ * split into cells x cells cells, but only cells the boundary passes
+ * through are ever integrated: tracing starts from the crossings on
+ * seed_lines + 1 evenly spaced rows and columns of grid points and spreads
+ * through cell edges whose two ends disagree. Islands that fit between
+ * those lines are missed. Each crossing is then narrowed down by
+ * bisection. */
+typedef struct BoundaryConfig {
+  double theta1, theta2; // Centre of the window
+  double span;           // Side of the window (rad)
+  long cells;            // Grid cells per side
+  double seconds;        // Flip horizon T
+  double tolerance;      // Bisect crossings down to this (rad)
+  size_t max_cells;      // Stop tracing after this many boundary cells
+  long seed_lines;       // Gaps between the rows and columns seeded from
+  int threads;
+} BoundaryConfig;
+
+/* One piece of the contour, from (a1, a2) to (b1, b2) in (theta1, theta2) */
+typedef struct BoundarySegment {
+  double a1, a2;
+  double b1, b2;
+} BoundarySegment;
+
+typedef struct BoundaryResult {
+  BoundarySegment *segments;
+  size_t n_segments;
+  size_t cells;       // Boundary cells traced
+  size_t corners;     // Grid points classified while tracing
+  size_t evaluations; // Initial conditions integrated
+} BoundaryResult;
+
+int traceBoundary(const BoundaryConfig *cfg, BoundaryResult *result);
+
+int boundaryMain(int argc, char **argv);
+
+#endif
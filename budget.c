@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include "budget.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BUDGET_SHARE 0.75 // Of the limit, the rest is for everything else
+
+/* Sits in front of every allocation, keeping it 64 byte aligned */
+typedef union Block {
+  struct {
+    size_t bytes; // Including the block
+    int component;
+    int spilled;
+  } h;
+  char pad[64];
+} Block;
+
+static const char *const names[N_COMPONENTS] = {
+    "ensemble", "history", "tiles", "trails", "buffers"};
+
+static size_t user_budget;
+static int report;
+static const char *spill_dir;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static size_t limit;
+static const char *source;
+
+static size_t held[N_COMPONENTS][2]; // Bytes in memory and on disk
+static size_t peak[N_COMPONENTS][2];
+static size_t in_memory;
+static int warned[N_COMPONENTS];
+
+static size_t parseSize(const char *s) {
+  char *end;
+  double v = strtod(s, &end);
+  switch (*end) {
+  case 'G':
+  case 'g':
+    v *= 1024;
+    /* fall through */
+  case 'M':
+  case 'm':
+    v *= 1024;
+    /* fall through */
+  case 'K':
+  case 'k':
+    v *= 1024;
+  }
+  return v > 0 ? (size_t)v : 0;
+}
+
+/* The tightest memory.max from this process's cgroup up to the root of
+ * the hierarchy, 0 if there is none */
+static size_t cgroupLimit(void) {
+  FILE *f = fopen("/proc/self/cgroup", "r");
+  char line[512], path[640];
+  size_t tightest = 0;
+  while (f && fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "0::/", 4)) {
+      continue; // Only the unified v2 hierarchy has memory.max
+    }
+    line[strcspn(line, "\n")] = 0;
+    char *dir = line + 3;
+    for (;;) {
+      snprintf(path, sizeof(path), "/sys/fs/cgroup%s/memory.max",
+               dir[1] ? dir : "");
+      FILE *max = fopen(path, "r");
+      char value[32];
+      if (max && fgets(value, sizeof(value), max) && value[0] != 'm') {
+        size_t bytes = strtoull(value, NULL, 10);
+        tightest = tightest && tightest < bytes ? tightest : bytes;
+      }
+      if (max) {
+        fclose(max);
+      }
+      char *slash = strrchr(dir, '/');
+      if (!dir[1]) {
+        break;
+      }
+      slash[slash == dir] = 0;
+    }
+  }
+  if (f) {
+    fclose(f);
+  }
+  return tightest;
+}
+
+static void detect(void) {
+  size_t cgroup = cgroupLimit();
+  size_t physical = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+  if (user_budget) {
+    limit = user_budget;
+    source = "--memory-budget";
+  } else if (cgroup && cgroup < physical) {
+    limit = cgroup * BUDGET_SHARE;
+    source = "cgroup memory.max";
+  } else {
+    limit = physical * BUDGET_SHARE;
+    source = "physical memory";
+  }
+  if (spill_dir == NULL) {
+    /* Not /tmp, which is often a tmpfs and so memory itself */
+    spill_dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/var/tmp";
+  }
+}
+
+int budgetOptions(int argc, char **argv) {
+  int n = 0;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--memory-budget") && i + 1 < argc) {
+      user_budget = parseSize(argv[++i]);
+    } else if (!strcmp(argv[i], "--spill-dir") && i + 1 < argc) {
+      spill_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--memory-report")) {
+      report = 1;
+    } else {
+      argv[n++] = argv[i];
+    }
+  }
+  return n;
+}
+
+size_t budgetLimit(void) {
+  pthread_once(&once, detect);
+  return limit;
+}
+
+size_t budgetFit(size_t want, size_t item, double share) {
+  size_t used = __atomic_load_n(&in_memory, __ATOMIC_RELAXED);
+  size_t left = budgetLimit() > used ? limit - used : 0;
+  size_t n = left * share / (item ? item : 1);
+  return n < 1 ? 1 : n < want ? n : want;
+}
+
+static void account(Component c, int spilled, size_t bytes, int sign) {
+  size_t now = __atomic_add_fetch(&held[c][spilled], sign * bytes,
+                                  __ATOMIC_RELAXED);
+  size_t was = __atomic_load_n(&peak[c][spilled], __ATOMIC_RELAXED);
+  while (now > was && !__atomic_compare_exchange_n(&peak[c][spilled], &was,
+                                                   now, 1, __ATOMIC_RELAXED,
+                                                   __ATOMIC_RELAXED)) {
+  }
+  if (!spilled) {
+    __atomic_add_fetch(&in_memory, sign * bytes, __ATOMIC_RELAXED);
+  }
+}
+
+/* An unlinked file of the given size mapped in, NULL if that failed */
+static void *spill(size_t bytes) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/double-pendulum-XXXXXX", spill_dir);
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return NULL;
+  }
+  unlink(path);
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, bytes) == 0) {
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+void *budgetAlloc(Component c, size_t bytes) {
+  size_t total = bytes + sizeof(Block);
+  size_t used = __atomic_load_n(&in_memory, __ATOMIC_RELAXED);
+  Block *b = NULL;
+  int spilled = used + total > budgetLimit();
+  if (spilled) {
+    b = spill(total);
+    if (b && !__atomic_exchange_n(&warned[c], 1, __ATOMIC_RELAXED)) {
+      /* stderr, as stdout may be carrying CSV */
+      fprintf(stderr, "Over the %.0f MB memory budget, spilling %s to %s\n",
+              limit / 1048576.0, names[c], spill_dir);
+    }
+    spilled = b != NULL;
+  }
+  if (b == NULL) {
+    /* Could not spill, so try memory anyway */
+    void *p;
+    if (posix_memalign(&p, sizeof(Block), total) != 0) {
+      return NULL;
+    }
+    b = memset(p, 0, total);
+  }
+  b->h.bytes = total;
+  b->h.component = c;
+  b->h.spilled = spilled;
+  account(c, spilled, total, 1);
+  return b + 1;
+}
+
+void budgetFree(void *p) {
+  if (p == NULL) {
+    return;
+  }
+  Block *b = (Block *)p - 1;
+  account(b->h.component, b->h.spilled, b->h.bytes, -1);
+  if (b->h.spilled) {
+    munmap(b, b->h.bytes);
+  } else {
+    free(b);
+  }
+}
+
+void budgetReport(void) {
+  if (!report) {
+    return;
+  }
+  printf("Memory budget %.1f MB from %s\n", budgetLimit() / 1048576.0,
+         source);
+  printf("%-10s %14s %14s\n", "component", "peak memory", "peak disk");
+  for (int c = 0; c < N_COMPONENTS; c++) {
+    printf("%-10s %11.2f MB %11.2f MB\n", names[c], peak[c][0] / 1048576.0,
+           peak[c][1] / 1048576.0);
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stddef.h>
+
+typedef enum Component {
+  MEM_ENSEMBLE, // Pendulum states
+  MEM_HISTORY,  // Viewer snapshots for rewinding
+  MEM_TILES,    // Sweep tiles in flight
+  MEM_TRAILS,   // Viewer trails
+  MEM_BUFFERS,  // Output buffers
+  N_COMPONENTS
+} Component;
+
+/* Take --memory-budget SIZE (with an optional K, M or G suffix),
+ * --memory-report and --spill-dir DIR out of argv, returning the new argc.
+ * Without a budget the limit is the memory.max of this process's cgroup
+ * v2 or its tightest ancestor, else the physical memory. */
+int budgetOptions(int argc, char **argv);
+
+/* Bytes the large allocations below may keep in memory, leaving headroom
+ * for everything else */
+size_t budgetLimit(void);
+
+/* Of want items of item bytes each, how many fit in share of what is left
+ * of the budget, at least 1 */
+size_t budgetFit(size_t want, size_t item, double share);
+
+/* Zeroed, 64 byte aligned memory for c. Past the budget it is an unlinked
+ * file in the spill directory mapped in instead, which the kernel can
+ * write out under pressure rather than the run being killed. */
+void *budgetAlloc(Component c, size_t bytes);
+void budgetFree(void *p);
+
+/* Bytes held per component in memory and on disk, if --memory-report */
+void budgetReport(void);
+
+#endif
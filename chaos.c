@@ -0,0 +1,373 @@
+#include "chaos.h"
+#include "ensemble.h"
+#include "image.h"
+#include "pool.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LANES ENSEMBLE_BLOCK
+#define ROWS (4 + 4 * CHAOS_VECTORS_MAX) // State, then each vector
+#define CHECK_EVERY 10 // Steps between renormalizing and testing
+#define EPSILON 1e-6   // Central difference step along a deviation vector
+
+/* A block of lanes integrated together. Slots are refilled from the task's
+ * cells as soon as their cell is classified, so chaotic cells that finish
+ * early don't leave the block running half empty. Once the cells run out,
+ * the live slots are kept packed at the front and only those are
+ * stepped. */
+typedef struct Slots {
+  double y[ROWS][LANES];
+  long cell[LANES];
+  long step[LANES];
+} Slots;
+
+typedef struct ChaosJob {
+  const ChaosConfig *cfg;
+  const Ensemble *e;
+  long steps;
+  double *index;
+  double *chaotic_time;
+  long total_steps;
+  pthread_mutex_t lock;
+} ChaosJob;
+
+/* Time derivative of the state and of every deviation vector. The tangent
+ * dynamics J v come from central differences of the accelerations along v,
+ * which is accurate to O(EPSILON^2) for unit length v. */
+static void derivative(const Ensemble *e, int nv, size_t m,
+                       double (*y)[LANES], double (*dy)[LANES]) {
+  double p[4][LANES], ap1[LANES], ap2[LANES], am1[LANES], am2[LANES];
+
+  ensembleAccel(e, 0, m, y[0], y[1], y[2], y[3], dy[2], dy[3]);
+  memcpy(dy[0], y[2], m * sizeof(double));
+  memcpy(dy[1], y[3], m * sizeof(double));
+
+  for (int k = 0; k < nv; k++) {
+    double(*v)[LANES] = y + 4 + 4 * k;
+    double(*dv)[LANES] = dy + 4 + 4 * k;
+
+    for (int c = 0; c < 4; c++) {
+      for (size_t i = 0; i < m; i++) {
+        p[c][i] = y[c][i] + EPSILON * v[c][i];
+      }
+    }
+    ensembleAccel(e, 0, m, p[0], p[1], p[2], p[3], ap1, ap2);
+    for (int c = 0; c < 4; c++) {
+      for (size_t i = 0; i < m; i++) {
+        p[c][i] = y[c][i] - EPSILON * v[c][i];
+      }
+    }
+    ensembleAccel(e, 0, m, p[0], p[1], p[2], p[3], am1, am2);
+
+    memcpy(dv[0], v[2], m * sizeof(double));
+    memcpy(dv[1], v[3], m * sizeof(double));
+    for (size_t i = 0; i < m; i++) {
+      dv[2][i] = (ap1[i] - am1[i]) / (2 * EPSILON);
+      dv[3][i] = (ap2[i] - am2[i]) / (2 * EPSILON);
+    }
+  }
+}
+
+/* One RK4 step of the state and tangent system together, of the first m
+ * lanes */
+static void step(const Ensemble *e, int nv, size_t m, double dt,
+                 double (*y)[LANES]) {
+  double k[4][ROWS][LANES], tmp[ROWS][LANES];
+  int rows = 4 + 4 * nv;
+
+  derivative(e, nv, m, y, k[0]);
+  for (int r = 0; r < rows; r++) {
+    for (size_t i = 0; i < m; i++) {
+      tmp[r][i] = y[r][i] + dt / 2 * k[0][r][i];
+    }
+  }
+  derivative(e, nv, m, tmp, k[1]);
+  for (int r = 0; r < rows; r++) {
+    for (size_t i = 0; i < m; i++) {
+      tmp[r][i] = y[r][i] + dt / 2 * k[1][r][i];
+    }
+  }
+  derivative(e, nv, m, tmp, k[2]);
+  for (int r = 0; r < rows; r++) {
+    for (size_t i = 0; i < m; i++) {
+      tmp[r][i] = y[r][i] + dt * k[2][r][i];
+    }
+  }
+  derivative(e, nv, m, tmp, k[3]);
+  for (int r = 0; r < rows; r++) {
+    for (size_t i = 0; i < m; i++) {
+      y[r][i] += dt / 6 * (k[0][r][i] + 2 * k[1][r][i] + 2 * k[2][r][i] +
+                           k[3][r][i]);
+    }
+  }
+}
+
+/* Normalize the deviation vectors of slot i and return SALI for two of them,
+ * or GALI_k, the volume spanned by k unit vectors, sqrt(det(V^T V)) */
+static double indicator(double (*y)[LANES], int nv, size_t i) {
+  double *v[CHAOS_VECTORS_MAX][4];
+  for (int k = 0; k < nv; k++) {
+    double norm = 0;
+    for (int c = 0; c < 4; c++) {
+      v[k][c] = &y[4 + 4 * k + c][i];
+      norm += *v[k][c] * *v[k][c];
+    }
+    norm = 1 / sqrt(norm);
+    for (int c = 0; c < 4; c++) {
+      *v[k][c] *= norm;
+    }
+  }
+
+  double gram[CHAOS_VECTORS_MAX][CHAOS_VECTORS_MAX];
+  for (int a = 0; a < nv; a++) {
+    for (int b = 0; b < nv; b++) {
+      gram[a][b] = 0;
+      for (int c = 0; c < 4; c++) {
+        gram[a][b] += *v[a][c] * *v[b][c];
+      }
+    }
+  }
+
+  /* Rounding can push |cos| just past 1 once the vectors line up */
+  if (nv == 2) {
+    return sqrt(fmax(2 - 2 * fabs(gram[0][1]), 0));
+  }
+
+  /* Gaussian elimination; the Gram matrix is symmetric positive
+   * semi-definite so no pivoting is needed */
+  double det = 1;
+  for (int a = 0; a < nv; a++) {
+    det *= gram[a][a];
+    if (gram[a][a] <= 0) {
+      return 0;
+    }
+    for (int b = a + 1; b < nv; b++) {
+      double f = gram[b][a] / gram[a][a];
+      for (int c = a; c < nv; c++) {
+        gram[b][c] -= f * gram[a][c];
+      }
+    }
+  }
+  return sqrt(fmax(det, 0));
+}
+
+static void fill(const ChaosJob *job, Slots *s, size_t i, long cell) {
+  const ChaosConfig *cfg = job->cfg;
+  s->cell[i] = cell;
+  s->step[i] = 0;
+  for (int r = 0; r < ROWS; r++) {
+    s->y[r][i] = 0;
+  }
+
+  int x = cell % cfg->width, y = cell / cfg->width;
+  s->y[0][i] = -M_PI + (x + 0.5) * 2 * M_PI / cfg->width;
+  s->y[1][i] = M_PI - (y + 0.5) * 2 * M_PI / cfg->height;
+
+  /* Start the vectors along the coordinate axes */
+  for (int k = 0; k < cfg->vectors; k++) {
+    s->y[4 + 4 * k + k][i] = 1;
+  }
+}
+
+/* Copy slot from over slot to */
+static void moveSlot(Slots *s, size_t to, size_t from) {
+  for (int r = 0; r < ROWS; r++) {
+    s->y[r][to] = s->y[r][from];
+  }
+  s->cell[to] = s->cell[from];
+  s->step[to] = s->step[from];
+}
+
+static void chaosTask(void *ctx, size_t begin, size_t end) {
+  ChaosJob *job = ctx;
+  int nv = job->cfg->vectors;
+  Slots s;
+  size_t next = begin;
+  size_t active = 0;
+  long steps = 0;
+
+  while (active < LANES && next < end) {
+    fill(job, &s, active++, next++);
+  }
+
+  while (active > 0) {
+    for (int n = 0; n < CHECK_EVERY; n++) {
+      step(job->e, nv, active, DT, s.y);
+    }
+
+    for (size_t i = 0; i < active; i++) {
+      s.step[i] += CHECK_EVERY;
+    }
+    for (size_t i = 0; i < active;) {
+      double index = indicator(s.y, nv, i);
+      int chaotic = index < job->cfg->threshold;
+      if (!chaotic && s.step[i] < job->steps) {
+        i++;
+        continue;
+      }
+
+      job->index[s.cell[i]] = index;
+      job->chaotic_time[s.cell[i]] = chaotic ? s.step[i] * DT : NAN;
+      steps += s.step[i];
+
+      /* Refill the slot, or else move the last live one into it and test
+       * that one next */
+      if (next < end) {
+        fill(job, &s, i++, next++);
+      } else {
+        moveSlot(&s, i, --active);
+      }
+    }
+  }
+
+  pthread_mutex_lock(&job->lock);
+  job->total_steps += steps;
+  pthread_mutex_unlock(&job->lock);
+}
+
+long runChaos(const ChaosConfig *cfg, double *index, double *chaotic_time) {
+  Body a = {.l = 1.0, .m = 1.0};
+  Body b = {.l = 1.0, .m = 1.0};
+
+  /* Only the parameters are used, lanes live in each task's slots */
+  Ensemble e;
+  if (ensembleInit(&e, 0, &a, &b) != 0) {
+    return -1;
+  }
+  Pool *pool = poolCreate(cfg->threads);
+  if (pool == NULL) {
+    ensembleFree(&e);
+    return -1;
+  }
+
+  ChaosJob job = {.cfg = cfg,
+                  .e = &e,
+                  .steps = (long)(cfg->seconds / DT),
+                  .index = index,
+                  .chaotic_time = chaotic_time};
+  pthread_mutex_init(&job.lock, NULL);
+  poolRun(pool, chaosTask, &job, (size_t)cfg->width * cfg->height, 4 * LANES);
+  pthread_mutex_destroy(&job.lock);
+
+  poolDestroy(pool);
+  ensembleFree(&e);
+  return job.total_steps;
+}
+
+/* double-pendulum --chaos [--width W] [--height H] [--seconds T]
+ *     [--vectors K] [--threshold X] [--threads T] [--output FILE]
+ *     [--png FILE]
+ *
+ * CSV of theta1, theta2, index and chaotic_time goes to stdout unless a
+ * file is asked for. The PNG shows chaotic cells brightest where they were
+ * caught soonest and regular ones black. */
+int chaosMain(int argc, char **argv) {
+  ChaosConfig cfg = {.width = 256,
+                     .height = 256,
+                     .seconds = 20.0,
+                     .vectors = 2,
+                     .threshold = 1e-8};
+  const char *output = NULL;
+  const char *png_path = NULL;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--width") && i + 1 < argc) {
+      cfg.width = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--height") && i + 1 < argc) {
+      cfg.height = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      cfg.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--vectors") && i + 1 < argc) {
+      cfg.vectors = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+      cfg.threshold = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      cfg.threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+      output = argv[++i];
+    } else if (!strcmp(argv[i], "--png") && i + 1 < argc) {
+      png_path = argv[++i];
+    }
+  }
+
+  if (cfg.width <= 0 || cfg.height <= 0) {
+    printf("Grid size must be positive\n");
+    return 1;
+  }
+  if (cfg.seconds <= DT) {
+    printf("--seconds must be longer than one step (%g)\n", DT);
+    return 1;
+  }
+  if (cfg.vectors < 2 || cfg.vectors > CHAOS_VECTORS_MAX) {
+    printf("--vectors must be between 2 and %d\n", CHAOS_VECTORS_MAX);
+    return 1;
+  }
+
+  size_t n = (size_t)cfg.width * cfg.height;
+  double *index = malloc(n * sizeof(double));
+  double *chaotic_time = malloc(n * sizeof(double));
+  if (index == NULL || chaotic_time == NULL) {
+    printf("Could not allocate %zu cells\n", n);
+    return 1;
+  }
+
+  long steps = runChaos(&cfg, index, chaotic_time);
+  int err = steps < 0;
+
+  if (!err && png_path) {
+    PngWriter *png = pngOpen(png_path, cfg.width, cfg.height, 1);
+    err = png == NULL;
+    for (int row = 0; row < cfg.height && !err; row++) {
+      PngStrip *strip = pngStrip(png, 1);
+      err = strip == NULL;
+      if (!err) {
+        colormapFlipTimes(chaotic_time + (size_t)row * cfg.width, cfg.width,
+                          DT, cfg.seconds, pngRow(png, strip, 0));
+        pngSubmit(png, strip);
+      }
+    }
+    if (png) {
+      err |= pngClose(png);
+    }
+  }
+
+  if (!err && (output || !png_path)) {
+    FILE *f = output ? fopen(output, "w") : stdout;
+    err = f == NULL;
+    if (f) {
+      fprintf(f, "theta1,theta2,index,chaotic_time\n");
+      for (size_t i = 0; i < n; i++) {
+        int x = i % cfg.width, y = i / cfg.width;
+        fprintf(f, "%.17g,%.17g,%.9g,%.9g\n",
+                -M_PI + (x + 0.5) * 2 * M_PI / cfg.width,
+                M_PI - (y + 0.5) * 2 * M_PI / cfg.height, index[i],
+                chaotic_time[i]);
+      }
+      err |= ferror(f);
+      if (output) {
+        err |= fclose(f) != 0;
+      }
+    }
+  }
+
+  if (!err && (output || png_path)) {
+    size_t chaotic = 0;
+    for (size_t i = 0; i < n; i++) {
+      chaotic += index[i] < cfg.threshold;
+    }
+    double full = (double)n * (long)(cfg.seconds / DT);
+    printf("%.1f%% of cells chaotic\n", 100.0 * chaotic / n);
+    printf("%ld steps taken, %.1f%% of running every cell to the end\n", steps,
+           100.0 * steps / full);
+  }
+  if (err) {
+    printf("Chaos map failed\n");
+  }
+
+  free(index);
+  free(chaotic_time);
+  return err;
+}
@@ -0,0 +1,28 @@
+#ifndef CHAOS_H
+#define CHAOS_H
+
+#include <stddef.h>
+
+#define CHAOS_VECTORS_MAX 4
+
+/* Regular/chaotic map over the same (theta1, theta2) grid as --sweep. Each
+ * cell carries 2 to 4 deviation vectors along with its state, propagated
+ * with the linearized equations of motion. With two vectors the indicator
+ * is SALI, with more it's GALI_k; both fall exponentially fast on chaotic
+ * orbits, which stop as soon as theirs drops below the threshold. */
+typedef struct ChaosConfig {
+  int width, height;
+  double seconds;   // Cells still above the threshold by then are regular
+  int vectors;      // Deviation vectors per cell
+  double threshold; // Index below which a cell counts as chaotic
+  int threads;
+} ChaosConfig;
+
+/* Per cell, row major: the last index computed and the time it fell below
+ * the threshold, NAN for regular cells. Returns the total steps taken, or -1
+ * on failure. */
+long runChaos(const ChaosConfig *cfg, double *index, double *chaotic_time);
+
+int chaosMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,295 @@
+#include "diff.h"
+#include "arrow.h"
+#include "pool.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIFF_BLOCK 256 // Rows reduced at a time by the chunk compare
+
+enum { STATE_T1, STATE_T2, STATE_W1, STATE_W2, N_STATE };
+
+static const char *const state_names[N_STATE] = {"theta1", "theta2", "omega1",
+                                                 "omega2"};
+
+typedef struct Trajectory {
+  ArrowFile *f;
+  int time;           // Column index, -1 without a time column
+  int state[N_STATE]; // Column indices
+} Trajectory;
+
+/* Columns of both recordings over rows [row, row + n), where n stops at the
+ * nearest batch boundary of either file */
+typedef struct Span {
+  const double *a[N_STATE];
+  const double *b[N_STATE];
+  long n;
+} Span;
+
+static int openTrajectory(Trajectory *t, const char *path) {
+  t->f = arrowMap(path);
+  if (t->f == NULL) {
+    printf("Could not read %s as an uncompressed Arrow IPC file\n", path);
+    return 1;
+  }
+
+  t->time = arrowColumnIndex(t->f, "time");
+  for (int c = 0; c < N_STATE; c++) {
+    t->state[c] = arrowColumnIndex(t->f, state_names[c]);
+    if (t->state[c] < 0 || t->f->types[t->state[c]] != ARROW_FLOAT64) {
+      printf("%s has no float64 column %s\n", path, state_names[c]);
+      arrowUnmap(t->f);
+      return 1;
+    }
+  }
+  if (t->time >= 0 && t->f->types[t->time] != ARROW_FLOAT64) {
+    t->time = -1;
+  }
+  return 0;
+}
+
+/* Batch holding row, by binary search over the batch start rows */
+static int findBatch(const ArrowFile *f, long row) {
+  int lo = 0;
+  int hi = f->n_batches - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (f->batches[mid].first_row <= row) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+static long spanAt(const Trajectory *a, const Trajectory *b, long row,
+                   long end, Span *s) {
+  int ba = findBatch(a->f, row);
+  int bb = findBatch(b->f, row);
+  long oa = row - a->f->batches[ba].first_row;
+  long ob = row - b->f->batches[bb].first_row;
+
+  s->n = end - row;
+  if (a->f->batches[ba].rows - oa < s->n) {
+    s->n = a->f->batches[ba].rows - oa;
+  }
+  if (b->f->batches[bb].rows - ob < s->n) {
+    s->n = b->f->batches[bb].rows - ob;
+  }
+
+  for (int c = 0; c < N_STATE; c++) {
+    s->a[c] = (const double *)arrowColumn(a->f, ba, a->state[c]) + oa;
+    s->b[c] = (const double *)arrowColumn(b->f, bb, b->state[c]) + ob;
+  }
+  return s->n;
+}
+
+static double timeAt(const Trajectory *t, long row) {
+  if (t->time < 0) {
+    return row;
+  }
+  int batch = findBatch(t->f, row);
+  const double *time = arrowColumn(t->f, batch, t->time);
+  return time[row - t->f->batches[batch].first_row];
+}
+
+/* Largest absolute state difference of n rows */
+static double maxError(const Span *s, long begin, long n) {
+  double err = 0;
+  for (int c = 0; c < N_STATE; c++) {
+    const double *x = s->a[c] + begin;
+    const double *y = s->b[c] + begin;
+    for (long i = 0; i < n; i++) {
+      err = fmax(err, fabs(x[i] - y[i]));
+    }
+  }
+  return err;
+}
+
+static double errorAt(const Trajectory *a, const Trajectory *b, long row) {
+  Span s;
+  spanAt(a, b, row, row + 1, &s);
+  return maxError(&s, 0, 1);
+}
+
+/* First row of [begin, end) whose error exceeds tolerance, end if none. Whole
+ * blocks are reduced with a vectorized max and only the block that crosses
+ * the tolerance is searched row by row. */
+static long firstDivergence(const Trajectory *a, const Trajectory *b,
+                            long begin, long end, double tolerance) {
+  Span s;
+  for (long row = begin; row < end; row += s.n) {
+    spanAt(a, b, row, end, &s);
+    for (long i = 0; i < s.n; i += DIFF_BLOCK) {
+      long n = s.n - i < DIFF_BLOCK ? s.n - i : DIFF_BLOCK;
+      if (maxError(&s, i, n) <= tolerance) {
+        continue;
+      }
+      for (long j = i;; j++) {
+        if (maxError(&s, j, 1) > tolerance) {
+          return row + j;
+        }
+      }
+    }
+  }
+  return end;
+}
+
+typedef struct CurveJob {
+  const Trajectory *a;
+  const Trajectory *b;
+  long rows;
+  int points;
+  double *err;
+} CurveJob;
+
+/* Max error over each of the curve's windows */
+static void curveTask(void *ctx, size_t begin, size_t end) {
+  CurveJob *job = ctx;
+  for (size_t p = begin; p < end; p++) {
+    long lo = job->rows * p / job->points;
+    long hi = job->rows * (p + 1) / job->points;
+    double err = 0;
+    Span s;
+    for (long row = lo; row < hi; row += s.n) {
+      spanAt(job->a, job->b, row, hi, &s);
+      err = fmax(err, maxError(&s, 0, s.n));
+    }
+    job->err[p] = err;
+  }
+}
+
+/* double-pendulum --diff A B [--tolerance X] [--keyframe K] [--points N]
+ *     [--exhaustive] [--threads T]
+ *
+ * A and B are Arrow recordings from --run --arrow. The first row where any
+ * of theta1, theta2, omega1, omega2 differs by more than X is found by
+ * binary search over every Kth row followed by a block compare of the last
+ * interval, which assumes that once diverged the runs stay diverged (chaos
+ * sees to that). --exhaustive scans every row instead. The growth curve is
+ * the max error over N equal windows. */
+int diffMain(int argc, char **argv) {
+  const char *paths[2] = {NULL, NULL};
+  double tolerance = 1e-6;
+  long keyframe = 4096;
+  int points = 32;
+  int exhaustive = 0;
+  int threads = 0;
+
+  int n_paths = 0;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--keyframe") && i + 1 < argc) {
+      keyframe = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--points") && i + 1 < argc) {
+      points = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--exhaustive")) {
+      exhaustive = 1;
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (n_paths < 2) {
+      paths[n_paths++] = argv[i];
+    }
+  }
+
+  if (n_paths < 2) {
+    printf("Usage: --diff A B [--tolerance X] [--keyframe K] [--points N]\n");
+    return 1;
+  }
+  if (keyframe <= 0 || points <= 0 || tolerance < 0) {
+    printf("--keyframe and --points must be positive, --tolerance not "
+           "negative\n");
+    return 1;
+  }
+
+  Trajectory a, b;
+  if (openTrajectory(&a, paths[0])) {
+    return 1;
+  }
+  if (openTrajectory(&b, paths[1])) {
+    arrowUnmap(a.f);
+    return 1;
+  }
+
+  long rows = a.f->rows < b.f->rows ? a.f->rows : b.f->rows;
+  if (a.f->rows != b.f->rows) {
+    printf("Row counts differ (%ld vs %ld), comparing the first %ld\n",
+           (long)a.f->rows, (long)b.f->rows, rows);
+  }
+  if (rows == 0) {
+    printf("Nothing to compare\n");
+    arrowUnmap(a.f);
+    arrowUnmap(b.f);
+    return 1;
+  }
+  if (timeAt(&a, 0) != timeAt(&b, 0) ||
+      timeAt(&a, rows - 1) != timeAt(&b, rows - 1)) {
+    printf("Time columns differ, the recordings weren't sampled alike\n");
+    arrowUnmap(a.f);
+    arrowUnmap(b.f);
+    return 1;
+  }
+
+  long first;
+  if (exhaustive) {
+    first = firstDivergence(&a, &b, 0, rows, tolerance);
+  } else {
+    /* Invariant: keyframe lo is within tolerance, keyframe hi isn't (or is
+     * one past the end) */
+    long last = (rows - 1) / keyframe;
+    long lo = -1;
+    long hi = last + 1;
+    while (hi - lo > 1) {
+      long mid = lo + (hi - lo) / 2;
+      if (errorAt(&a, &b, mid * keyframe) > tolerance) {
+        hi = mid;
+      } else {
+        lo = mid;
+      }
+    }
+    if (lo < 0) {
+      first = 0;
+    } else {
+      long end = hi > last ? rows : hi * keyframe + 1;
+      first = firstDivergence(&a, &b, lo * keyframe + 1, end, tolerance);
+    }
+  }
+
+  if (first == rows) {
+    printf("No divergence above %.3g in %ld rows (%.6g s)\n", tolerance, rows,
+           timeAt(&a, rows - 1));
+  } else {
+    Span s;
+    spanAt(&a, &b, first, first + 1, &s);
+    printf("First divergence above %.3g at row %ld, t = %.9g s\n", tolerance,
+           first, timeAt(&a, first));
+    for (int c = 0; c < N_STATE; c++) {
+      printf("  %-7s %.17g  %.17g\n", state_names[c], s.a[c][0], s.b[c][0]);
+    }
+  }
+
+  if (points > rows) {
+    points = rows;
+  }
+  CurveJob job = {.a = &a, .b = &b, .rows = rows, .points = points};
+  job.err = malloc(points * sizeof(double));
+  Pool *pool = poolCreate(threads);
+  poolRun(pool, curveTask, &job, points, 1);
+  poolDestroy(pool);
+
+  printf("\n%12s %14s %8s\n", "t_end", "max_error", "log10");
+  for (int p = 0; p < points; p++) {
+    long end = rows * (p + 1) / points - 1;
+    printf("%12.6g %14.6e %8.2f\n", timeAt(&a, end), job.err[p],
+           job.err[p] > 0 ? log10(job.err[p]) : -99.0);
+  }
+
+  free(job.err);
+  arrowUnmap(a.f);
+  arrowUnmap(b.f);
+  return 0;
+}
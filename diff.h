@@ -0,0 +1,8 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+/* double-pendulum --diff: compare two recorded trajectories and report where
+ * they first diverge and how the error grows afterwards */
+int diffMain(int argc, char **argv);
+
+#endif
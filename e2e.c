@@ -0,0 +1,381 @@
+#define _GNU_SOURCE
+#include "e2e.h"
+#include "clock.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define E2E_ARGS 16
+#define E2E_SCENARIOS 8
+#define E2E_META 8
+#define E2E_JITTER 0.01 // Seconds of process start-up noise
+
+/* A run of this binary. Arguments starting with @ name a file in the
+ * scratch directory, removed after every repeat. */
+typedef struct Scenario {
+  const char *name;
+  const char *args[E2E_ARGS];
+} Scenario;
+
+static const Scenario full[] = {
+    {"sweep-2048",
+     {"--sweep", "--width", "2048", "--height", "2048", "--png",
+      "@sweep.png"}},
+    {"montecarlo-1e6",
+     {"--montecarlo", "--max-samples", "1000000", "--target-flip", "1e-9",
+      "--target-energy", "1e-9"}},
+    {"run-1e8",
+     {"--run", "--seconds", "1000000", "--every", "100", "--arrow",
+      "@run.arrow"}},
+    {"viewer-3000",
+     {"--pendulums", "1000", "--scenes", "4", "--script", "3000"}},
+};
+
+/* The same pipelines at a size that finishes in seconds */
+static const Scenario quick[] = {
+    {"sweep-256",
+     {"--sweep", "--width", "256", "--height", "256", "--png",
+      "@sweep.png"}},
+    {"montecarlo-1e4",
+     {"--montecarlo", "--max-samples", "10000", "--target-flip", "1e-9",
+      "--target-energy", "1e-9"}},
+    {"run-1e6",
+     {"--run", "--seconds", "10000", "--every", "100", "--arrow",
+      "@run.arrow"}},
+    {"viewer-300",
+     {"--pendulums", "100", "--scenes", "4", "--script", "300"}},
+};
+
+typedef struct Result {
+  char name[32];
+  double median, low, high; // Wall seconds over the repeats
+  double cpu;               // Mean user + system seconds
+  long rss;                 // Peak resident set (kB)
+} Result;
+
+/* "key: value" lines describing where results were taken */
+typedef struct Meta {
+  char key[E2E_META][16];
+  char value[E2E_META][256];
+  int n;
+} Meta;
+
+static void metaAdd(Meta *m, const char *key, const char *value) {
+  if (m->n < E2E_META) {
+    snprintf(m->key[m->n], sizeof(m->key[0]), "%.15s", key);
+    snprintf(m->value[m->n], sizeof(m->value[0]), "%.255s", value);
+    m->n++;
+  }
+}
+
+static const char *metaGet(const Meta *m, const char *key) {
+  for (int i = 0; i < m->n; i++) {
+    if (!strcmp(m->key[i], key)) {
+      return m->value[i];
+    }
+  }
+  return "";
+}
+
+/* Host, kernel, CPU model and the SIMD extensions the kernels can use */
+static void hostMeta(Meta *m) {
+  static const char *const wanted[] = {"sse4_2", "avx",   "avx2", "fma",
+                                       "avx512f", "asimd", "sve"};
+  struct utsname u;
+  char line[4096], model[256] = "unknown", features[256] = "";
+  uname(&u);
+  metaAdd(m, "host", u.nodename);
+  snprintf(line, sizeof(line), "%s %s %s", u.sysname, u.release, u.machine);
+  metaAdd(m, "system", line);
+
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  while (f && fgets(line, sizeof(line), f)) {
+    char *colon = strchr(line, ':');
+    if (colon == NULL) {
+      continue;
+    }
+    line[strcspn(line, "\n")] = 0;
+    if (!strncmp(line, "model name", 10) && !strcmp(model, "unknown")) {
+      snprintf(model, sizeof(model), "%s", colon + 2);
+    } else if ((!strncmp(line, "flags", 5) || !strncmp(line, "Features", 8)) &&
+               features[0] == 0) {
+      /* Whole words only, so avx does not match avx2 */
+      char words[sizeof(line) + 1];
+      snprintf(words, sizeof(words), "%s ", colon + 1);
+      for (size_t w = 0; w < sizeof(wanted) / sizeof(wanted[0]); w++) {
+        char pattern[32];
+        snprintf(pattern, sizeof(pattern), " %s ", wanted[w]);
+        if (strstr(words, pattern)) {
+          strcat(features, features[0] ? " " : "");
+          strcat(features, wanted[w]);
+        }
+      }
+    }
+  }
+  if (f) {
+    fclose(f);
+  }
+  metaAdd(m, "cpu", model);
+  metaAdd(m, "features", features[0] ? features : "none");
+  snprintf(line, sizeof(line), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+  metaAdd(m, "cores", line);
+  metaAdd(m, "compiler", __VERSION__);
+  time_t now = time(NULL);
+  strftime(line, sizeof(line), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+  metaAdd(m, "date", line);
+}
+
+/* Run this binary with the scenario's arguments, its output discarded */
+static int runOnce(const Scenario *s, const char *dir, double *wall,
+                   struct rusage *usage) {
+  char paths[E2E_ARGS][512];
+  char *argv[E2E_ARGS + 2] = {"double-pendulum"};
+  int argc = 1;
+  for (int i = 0; i < E2E_ARGS && s->args[i]; i++) {
+    if (s->args[i][0] == '@') {
+      snprintf(paths[i], sizeof(paths[i]), "%s/%s", dir, s->args[i] + 1);
+      argv[argc++] = paths[i];
+    } else {
+      argv[argc++] = (char *)s->args[i];
+    }
+  }
+  argv[argc] = NULL;
+
+  double start = nowSeconds();
+  pid_t pid = fork();
+  if (pid == 0) {
+    /* The viewer draws offscreen, so a display is not needed */
+    setenv("SDL_VIDEODRIVER", "dummy", 0);
+    setenv("SDL_RENDER_DRIVER", "software", 0);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    execv("/proc/self/exe", argv);
+    _exit(127);
+  }
+  int status = 0;
+  int err = pid < 0 || wait4(pid, &status, 0, usage) < 0;
+  *wall = nowSeconds() - start;
+
+  /* Whatever happened, so the scratch directory can be removed */
+  for (int i = 0; i < E2E_ARGS && s->args[i]; i++) {
+    if (s->args[i][0] == '@') {
+      unlink(paths[i]);
+    }
+  }
+  return err || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int measure(const Scenario *s, const char *dir, int repeats,
+                   Result *r) {
+  double walls[repeats];
+  snprintf(r->name, sizeof(r->name), "%s", s->name);
+  r->cpu = 0;
+  r->rss = 0;
+  for (int k = 0; k < repeats; k++) {
+    struct rusage usage;
+    if (runOnce(s, dir, &walls[k], &usage)) {
+      return 1;
+    }
+    r->cpu += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+              usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+    r->rss = usage.ru_maxrss > r->rss ? usage.ru_maxrss : r->rss;
+  }
+  qsort(walls, repeats, sizeof(double), compareDoubles);
+  r->median = walls[repeats / 2];
+  r->low = walls[0];
+  r->high = walls[repeats - 1];
+  r->cpu /= repeats;
+  return 0;
+}
+
+static int save(const char *path, const Meta *m, const Result *r, int n) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    return 1;
+  }
+  fprintf(f, "# double-pendulum bench-e2e\n");
+  for (int i = 0; i < m->n; i++) {
+    fprintf(f, "# %s: %s\n", m->key[i], m->value[i]);
+  }
+  fprintf(f, "scenario,median_s,min_s,max_s,cpu_s,max_rss_kb\n");
+  for (int i = 0; i < n; i++) {
+    fprintf(f, "%s,%.4f,%.4f,%.4f,%.4f,%ld\n", r[i].name, r[i].median,
+            r[i].low, r[i].high, r[i].cpu, r[i].rss);
+  }
+  return fclose(f) != 0;
+}
+
+/* Read a file written by save(), returning the number of results or -1 */
+static int load(const char *path, Meta *m, Result *r, int max) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  char line[512];
+  int n = 0;
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\n")] = 0;
+    char *colon = strstr(line, ": ");
+    if (line[0] == '#' && colon) {
+      *colon = 0;
+      metaAdd(m, line + 2, colon + 2);
+    } else if (line[0] != '#' && n < max &&
+               sscanf(line, "%31[^,],%lf,%lf,%lf,%lf,%ld", r[n].name,
+                      &r[n].median, &r[n].low, &r[n].high, &r[n].cpu,
+                      &r[n].rss) == 6) {
+      n++;
+    }
+  }
+  fclose(f);
+  return n;
+}
+
+/* Flags scenarios slower than the baseline by more than threshold, or by
+ * more than the spread of both sets of repeats or E2E_JITTER when those are
+ * wider, since a noisy scenario cannot show a smaller change. Returns the
+ * number flagged. */
+static int compare(const Meta *base_meta, const Result *base, int n_base,
+                   const Meta *meta, const Result *r, int n,
+                   double threshold) {
+  if (strcmp(metaGet(base_meta, "cpu"), metaGet(meta, "cpu")) ||
+      strcmp(metaGet(base_meta, "cores"), metaGet(meta, "cores"))) {
+    printf("Baseline is from %s (%s, %s cores), timings may not be "
+           "comparable\n",
+           metaGet(base_meta, "host"), metaGet(base_meta, "cpu"),
+           metaGet(base_meta, "cores"));
+  }
+  printf("%-16s %10s %10s %8s %8s\n", "scenario", "baseline", "now",
+         "change", "allowed");
+  int slower = 0;
+  for (int i = 0; i < n; i++) {
+    const Result *b = NULL;
+    for (int j = 0; j < n_base; j++) {
+      if (!strcmp(base[j].name, r[i].name)) {
+        b = &base[j];
+      }
+    }
+    if (b == NULL || b->median <= 0) {
+      printf("%-16s %10s %9.3fs %8s %8s new\n", r[i].name, "-", r[i].median,
+             "-", "-");
+      continue;
+    }
+    double noise = (b->high - b->low) / b->median +
+                   (r[i].high - r[i].low) / r[i].median;
+    double allowed = noise > threshold ? noise : threshold;
+    if (E2E_JITTER / b->median > allowed) {
+      allowed = E2E_JITTER / b->median;
+    }
+    double change = r[i].median / b->median - 1;
+    const char *verdict = "ok";
+    if (change > allowed) {
+      verdict = "SLOWER";
+      slower++;
+    } else if (change < -allowed) {
+      verdict = "faster";
+    }
+    printf("%-16s %9.3fs %9.3fs %+7.1f%% %7.1f%% %s\n", r[i].name, b->median,
+           r[i].median, change * 100, allowed * 100, verdict);
+  }
+  return slower;
+}
+
+/* double-pendulum --bench-e2e [--quick] [--repeats R] [--output FILE]
+ *     [--baseline FILE] [--threshold F]
+ *
+ * Times whole runs of a large sweep, Monte Carlo estimate, recording and
+ * scripted viewer session, R times each, and saves the median, range, CPU
+ * time and peak memory with a description of the host to FILE. Given a
+ * baseline from an earlier run, it exits with 1 if any scenario got
+ * slower by more than F (default 0.05) or its noise. */
+int e2eMain(int argc, char **argv) {
+  const Scenario *scenarios = full;
+  int n = sizeof(full) / sizeof(full[0]);
+  int repeats = 3;
+  const char *output = "bench-e2e.csv";
+  const char *baseline = NULL;
+  double threshold = 0.05;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--quick")) {
+      scenarios = quick;
+      n = sizeof(quick) / sizeof(quick[0]);
+    } else if (!strcmp(argv[i], "--repeats") && i + 1 < argc) {
+      repeats = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+      output = argv[++i];
+    } else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+      baseline = argv[++i];
+    } else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    }
+  }
+
+  if (repeats <= 0 || threshold < 0) {
+    printf("--repeats and --threshold must be positive\n");
+    return 1;
+  }
+
+  const char *tmp = getenv("TMPDIR");
+  char dir[256];
+  snprintf(dir, sizeof(dir), "%s/double-pendulum-XXXXXX", tmp ? tmp : "/tmp");
+  if (mkdtemp(dir) == NULL) {
+    printf("Could not create a scratch directory in %s\n", dir);
+    return 1;
+  }
+
+  Meta meta = {0};
+  hostMeta(&meta);
+  Result results[E2E_SCENARIOS];
+  printf("%-16s %10s %10s %10s %10s\n", "scenario", "median", "range", "cpu",
+         "peak RSS");
+  int err = 0;
+  for (int s = 0; s < n && !err; s++) {
+    Result *r = &results[s];
+    err = measure(&scenarios[s], dir, repeats, r);
+    if (err) {
+      printf("%s failed\n", scenarios[s].name);
+    } else {
+      printf("%-16s %9.3fs %9.3fs %9.3fs %8ldMB\n", r->name, r->median,
+             r->high - r->low, r->cpu, r->rss / 1024);
+    }
+  }
+  rmdir(dir);
+  if (err) {
+    return 1;
+  }
+
+  if (save(output, &meta, results, n)) {
+    printf("Could not write %s\n", output);
+    return 1;
+  }
+  if (baseline == NULL) {
+    return 0;
+  }
+
+  Meta base_meta = {0};
+  Result base[E2E_SCENARIOS];
+  int n_base = load(baseline, &base_meta, base, E2E_SCENARIOS);
+  if (n_base < 0) {
+    printf("No baseline at %s, copy %s there to start one\n", baseline,
+           output);
+    return 0;
+  }
+  int slower = compare(&base_meta, base, n_base, &meta, results, n, threshold);
+  if (slower) {
+    printf("%d scenario%s slower than %s\n", slower, slower > 1 ? "s" : "",
+           baseline);
+  }
+  return slower > 0;
+}
@@ -0,0 +1,7 @@
+#ifndef E2E_H
+#define E2E_H
+
+/* double-pendulum --bench-e2e: whole-program scenarios against a baseline */
+int e2eMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,71 @@
+#include "energy.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+
+#define POWERCAP "/sys/class/powercap"
+
+/* Microjoules in a sysfs file as joules, negative if it can't be read */
+static double readJoules(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  unsigned long long uj;
+  int ok = fscanf(f, "%llu", &uj) == 1;
+  fclose(f);
+  return ok ? uj * 1e-6 : -1;
+}
+
+int energyOpen(EnergyMeter *m) {
+  memset(m, 0, sizeof(EnergyMeter));
+  DIR *dir = opendir(POWERCAP);
+  if (dir == NULL) {
+    return 0;
+  }
+
+  /* Only whole packages (intel-rapl:N, also used on AMD), since their
+   * core and uncore subzones are already counted in them */
+  struct dirent *d;
+  while ((d = readdir(dir)) != NULL && m->n < ENERGY_DOMAINS) {
+    int package, end = 0;
+    if (sscanf(d->d_name, "intel-rapl:%d%n", &package, &end) != 1 ||
+        d->d_name[end] != '\0') {
+      continue;
+    }
+    char range_path[128];
+    snprintf(m->path[m->n], sizeof(m->path[0]),
+             POWERCAP "/intel-rapl:%d/energy_uj", package);
+    snprintf(range_path, sizeof(range_path),
+             POWERCAP "/intel-rapl:%d/max_energy_range_uj", package);
+    double range = readJoules(range_path);
+    if (readJoules(m->path[m->n]) >= 0 && range > 0) {
+      m->range[m->n++] = range;
+    }
+  }
+  closedir(dir);
+  return m->n;
+}
+
+void energyStart(EnergyMeter *m) {
+  for (int k = 0; k < m->n; k++) {
+    m->start[k] = readJoules(m->path[k]);
+  }
+}
+
+double energyStop(const EnergyMeter *m) {
+  if (m->n == 0) {
+    return -1;
+  }
+  double total = 0;
+  for (int k = 0; k < m->n; k++) {
+    double now = readJoules(m->path[k]);
+    if (now < 0 || m->start[k] < 0) {
+      return -1; // Not a wrap, the counter went away
+    }
+    double used = now - m->start[k];
+    total += used < 0 ? used + m->range[k] : used;
+  }
+  return total;
+}
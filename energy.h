@@ -0,0 +1,26 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#define ENERGY_DOMAINS 8 // Most RAPL packages read
+
+/* Energy used by the cpu packages, from the RAPL counters Linux exposes
+ * under /sys/class/powercap. Machines without them, or where the counters
+ * are readable by root only, simply report nothing. */
+typedef struct EnergyMeter {
+  int n; // Package domains found, 0 if energy can't be measured here
+  char path[ENERGY_DOMAINS][96];
+  double range[ENERGY_DOMAINS]; // Joules at which each counter wraps
+  double start[ENERGY_DOMAINS];
+} EnergyMeter;
+
+/* Returns the number of readable domains */
+int energyOpen(EnergyMeter *m);
+
+void energyStart(EnergyMeter *m);
+
+/* Joules used by every package since energyStart(), allowing for one wrap
+ * of each counter. Negative if there are no counters or one of them could
+ * not be read. */
+double energyStop(const EnergyMeter *m);
+
+#endif
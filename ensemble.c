@@ -0,0 +1,278 @@
+#include "ensemble.h"
+#include "budget.h"
+#include "metrics.h"
+#include "rng.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double zeros[ENSEMBLE_BLOCK];
+
+static double *allocLanes(size_t n) {
+  /* Round up so every block can be loaded whole and aligned */
+  size_t bytes = ((n + ENSEMBLE_BLOCK - 1) / ENSEMBLE_BLOCK) * ENSEMBLE_BLOCK *
+                 sizeof(double);
+  return budgetAlloc(MEM_ENSEMBLE, bytes);
+}
+
+int ensembleInit(Ensemble *e, size_t n, const Body *a, const Body *b) {
+  memset(e, 0, sizeof(*e));
+  e->n = n;
+  e->l1 = a->l;
+  e->l2 = b->l;
+  e->m1 = a->m;
+  e->m2 = b->m;
+  e->g = G;
+
+  e->t1 = allocLanes(n);
+  e->t2 = allocLanes(n);
+  e->w1 = allocLanes(n);
+  e->w2 = allocLanes(n);
+  if (!e->t1 || !e->t2 || !e->w1 || !e->w2) {
+    ensembleFree(e);
+    return 1;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    ensembleSet(e, i, a, b);
+  }
+  return 0;
+}
+
+void ensembleFree(Ensemble *e) {
+  budgetFree(e->t1);
+  budgetFree(e->t2);
+  budgetFree(e->w1);
+  budgetFree(e->w2);
+  e->t1 = e->t2 = e->w1 = e->w2 = NULL;
+  e->n = 0;
+}
+
+void ensembleSet(Ensemble *e, size_t i, const Body *a, const Body *b) {
+  e->t1[i] = a->t;
+  e->t2[i] = b->t;
+  e->w1[i] = a->w;
+  e->w2[i] = b->w;
+}
+
+void ensembleGet(const Ensemble *e, size_t i, Body *a, Body *b) {
+  a->l = e->l1;
+  a->m = e->m1;
+  a->t = e->t1[i];
+  a->w = e->w1[i];
+  a->torque = e->u1 ? e->u1[i] : 0;
+  b->l = e->l2;
+  b->m = e->m2;
+  b->t = e->t2[i];
+  b->w = e->w2[i];
+  b->torque = e->u2 ? e->u2[i] : 0;
+}
+
+void ensembleEnergy(const Ensemble *e, size_t begin, size_t end,
+                    double *restrict energy) {
+  const double *t1 = e->t1, *t2 = e->t2, *w1 = e->w1, *w2 = e->w2;
+
+  for (size_t i = begin; i < end; i++) {
+    double y1 = -e->l1 * sin(t1[i] + M_PI_2);
+    double y2 = y1 - e->l2 * sin(t2[i] + M_PI_2);
+    double av2 = (e->l1 * w1[i]) * (e->l1 * w1[i]);
+    double bv2 = (e->l2 * w2[i]) * (e->l2 * w2[i]);
+    double cross = 2 * e->l1 * e->l2 * w1[i] * w2[i] *
+                   sin(t1[i] - t2[i] + M_PI_2);
+    double g = e->gravity ? e->gravity[i] : e->g;
+
+    energy[i] = e->m1 * g * y1 + e->m2 * g * y2 + 0.5 * e->m1 * av2 +
+                0.5 * e->m2 * (av2 + bv2 + cross);
+  }
+}
+
+/* Without per-lane gravity every block reads e->g from a filled array */
+static void fillGravity(const Ensemble *e, double *g) {
+  for (size_t i = 0; i < ENSEMBLE_BLOCK; i++) {
+    g[i] = e->g;
+  }
+}
+
+/* Angular accelerations for m lanes, the same equations as lagrange() plus
+ * viscous damping */
+static void accel(const Ensemble *e, size_t m, const double *restrict t1,
+                  const double *restrict t2, const double *restrict w1,
+                  const double *restrict w2, const double *restrict u1,
+                  const double *restrict u2, const double *restrict gl,
+                  double *restrict g1, double *restrict g2) {
+  double b_a = e->l2 / e->l1;
+  double a_b = e->l1 / e->l2;
+  double mass_ratio = e->m2 / (e->m1 + e->m2);
+  double inv_l1 = 1.0 / e->l1;
+  double inv_l2 = 1.0 / e->l2;
+  double inertia_1 = 1.0 / ((e->m1 + e->m2) * e->l1 * e->l1);
+  double inertia_2 = 1.0 / (e->m2 * e->l2 * e->l2);
+
+  for (size_t i = 0; i < m; i++) {
+    /* Written as two sines so gcc doesn't fuse them into a scalar sincos()
+     * call and can use the libmvec vector variant instead */
+    double s = sin(t1[i] - t2[i]);
+    double c = sin(t1[i] - t2[i] + M_PI_2);
+
+    double accel_1 = b_a * mass_ratio * c;
+    double accel_2 = a_b * c;
+
+    double force_1 = -b_a * mass_ratio * (w2[i] * w2[i]) * s -
+                     gl[i] * inv_l1 * sin(t1[i]) +
+                     (u1[i] - e->gamma * w1[i]) * inertia_1;
+    double force_2 = a_b * (w1[i] * w1[i]) * s - gl[i] * inv_l2 * sin(t2[i]) +
+                     (u2[i] - e->gamma * w2[i]) * inertia_2;
+
+    double det = 1.0 / (1 - accel_1 * accel_2);
+    g1[i] = (force_1 - accel_1 * force_2) * det;
+    g2[i] = (force_2 - accel_2 * force_1) * det;
+  }
+}
+
+void ensembleAccel(const Ensemble *e, size_t begin, size_t m,
+                   const double *t1, const double *t2, const double *w1,
+                   const double *w2, double *a1, double *a2) {
+  double g[ENSEMBLE_BLOCK];
+  fillGravity(e, g);
+  accel(e, m, t1, t2, w1, w2, e->u1 ? e->u1 + begin : zeros,
+        e->u2 ? e->u2 + begin : zeros, e->gravity ? e->gravity + begin : g,
+        a1, a2);
+  metricsAdd(COUNTER_LAGRANGE, m);
+}
+
+void ensembleStepRange(const Ensemble *e, double dt, size_t begin,
+                       size_t end) {
+  double k1[4][ENSEMBLE_BLOCK], k2[4][ENSEMBLE_BLOCK];
+  double k3[4][ENSEMBLE_BLOCK], k4[4][ENSEMBLE_BLOCK];
+  double tmp[4][ENSEMBLE_BLOCK];
+  double g[ENSEMBLE_BLOCK];
+  fillGravity(e, g);
+
+  for (size_t s = begin; s < end; s += ENSEMBLE_BLOCK) {
+    size_t m = end - s < ENSEMBLE_BLOCK ? end - s : ENSEMBLE_BLOCK;
+    double *t1 = e->t1 + s, *t2 = e->t2 + s;
+    double *w1 = e->w1 + s, *w2 = e->w2 + s;
+    const double *u1 = e->u1 ? e->u1 + s : zeros;
+    const double *u2 = e->u2 ? e->u2 + s : zeros;
+    const double *gl = e->gravity ? e->gravity + s : g;
+
+    accel(e, m, t1, t2, w1, w2, u1, u2, gl, k1[2], k1[3]);
+
+    for (size_t i = 0; i < m; i++) {
+      tmp[0][i] = t1[i] + dt * w1[i] / 2;
+      tmp[1][i] = t2[i] + dt * w2[i] / 2;
+      tmp[2][i] = w1[i] + dt * k1[2][i] / 2;
+      tmp[3][i] = w2[i] + dt * k1[3][i] / 2;
+    }
+    accel(e, m, tmp[0], tmp[1], tmp[2], tmp[3], u1, u2, gl, k2[2], k2[3]);
+    memcpy(k2[0], tmp[2], m * sizeof(double));
+    memcpy(k2[1], tmp[3], m * sizeof(double));
+
+    for (size_t i = 0; i < m; i++) {
+      tmp[0][i] = t1[i] + dt * k2[0][i] / 2;
+      tmp[1][i] = t2[i] + dt * k2[1][i] / 2;
+      tmp[2][i] = w1[i] + dt * k2[2][i] / 2;
+      tmp[3][i] = w2[i] + dt * k2[3][i] / 2;
+    }
+    accel(e, m, tmp[0], tmp[1], tmp[2], tmp[3], u1, u2, gl, k3[2], k3[3]);
+    memcpy(k3[0], tmp[2], m * sizeof(double));
+    memcpy(k3[1], tmp[3], m * sizeof(double));
+
+    for (size_t i = 0; i < m; i++) {
+      tmp[0][i] = t1[i] + dt * k3[0][i];
+      tmp[1][i] = t2[i] + dt * k3[1][i];
+      tmp[2][i] = w1[i] + dt * k3[2][i];
+      tmp[3][i] = w2[i] + dt * k3[3][i];
+    }
+    accel(e, m, tmp[0], tmp[1], tmp[2], tmp[3], u1, u2, gl, k4[2], k4[3]);
+
+    for (size_t i = 0; i < m; i++) {
+      double v1 = tmp[2][i], v2 = tmp[3][i];
+      t1[i] += dt / 6.0 * (w1[i] + 2.0 * k2[0][i] + 2.0 * k3[0][i] + v1);
+      t2[i] += dt / 6.0 * (w2[i] + 2.0 * k2[1][i] + 2.0 * k3[1][i] + v2);
+      w1[i] += dt / 6.0 *
+               (k1[2][i] + 2.0 * k2[2][i] + 2.0 * k3[2][i] + k4[2][i]);
+      w2[i] += dt / 6.0 *
+               (k1[3][i] + 2.0 * k2[3][i] + 2.0 * k3[3][i] + k4[3][i]);
+    }
+  }
+  metricsAdd(COUNTER_STEPS, end - begin);
+  metricsAdd(COUNTER_LAGRANGE, 4 * (end - begin));
+}
+
+typedef struct StepJob {
+  const Ensemble *e;
+  double dt;
+} StepJob;
+
+static void stepTask(void *ctx, size_t begin, size_t end) {
+  StepJob *job = ctx;
+  ensembleStepRange(job->e, job->dt, begin, end);
+}
+
+void ensembleStep(Ensemble *e, Pool *pool, double dt) {
+  StepJob job = {.e = e, .dt = dt};
+  poolRun(pool, stepTask, &job, e->n, 16 * ENSEMBLE_BLOCK);
+}
+
+void ensembleLangevinRange(const Ensemble *e, double dt, uint64_t seed,
+                           uint64_t step, size_t begin, size_t end) {
+  double k1[2][ENSEMBLE_BLOCK], k2[2][ENSEMBLE_BLOCK];
+  double pred[4][ENSEMBLE_BLOCK];
+  double f1[ENSEMBLE_BLOCK], f2[ENSEMBLE_BLOCK];
+  double sigma = sqrt(2 * e->gamma * e->kT / dt);
+  double g[ENSEMBLE_BLOCK];
+  fillGravity(e, g);
+
+  for (size_t s = begin; s < end; s += ENSEMBLE_BLOCK) {
+    size_t m = end - s < ENSEMBLE_BLOCK ? end - s : ENSEMBLE_BLOCK;
+    double *t1 = e->t1 + s, *t2 = e->t2 + s;
+    double *w1 = e->w1 + s, *w2 = e->w2 + s;
+    const double *gl = e->gravity ? e->gravity + s : g;
+
+    /* The noise enters as a torque held fixed over the step, so both Heun
+     * stages see the same increment */
+    philoxNormals(seed, s, step, m, f1, f2);
+    for (size_t i = 0; i < m; i++) {
+      f1[i] = sigma * f1[i] + (e->u1 ? e->u1[s + i] : 0);
+      f2[i] = sigma * f2[i] + (e->u2 ? e->u2[s + i] : 0);
+    }
+
+    accel(e, m, t1, t2, w1, w2, f1, f2, gl, k1[0], k1[1]);
+    for (size_t i = 0; i < m; i++) {
+      pred[0][i] = t1[i] + dt * w1[i];
+      pred[1][i] = t2[i] + dt * w2[i];
+      pred[2][i] = w1[i] + dt * k1[0][i];
+      pred[3][i] = w2[i] + dt * k1[1][i];
+    }
+
+    accel(e, m, pred[0], pred[1], pred[2], pred[3], f1, f2, gl, k2[0], k2[1]);
+    for (size_t i = 0; i < m; i++) {
+      t1[i] += dt / 2 * (w1[i] + pred[2][i]);
+      t2[i] += dt / 2 * (w2[i] + pred[3][i]);
+      w1[i] += dt / 2 * (k1[0][i] + k2[0][i]);
+      w2[i] += dt / 2 * (k1[1][i] + k2[1][i]);
+    }
+  }
+  metricsAdd(COUNTER_STEPS, end - begin);
+  metricsAdd(COUNTER_LAGRANGE, 2 * (end - begin));
+}
+
+typedef struct LangevinJob {
+  const Ensemble *e;
+  double dt;
+  uint64_t seed;
+  uint64_t step;
+} LangevinJob;
+
+static void langevinTask(void *ctx, size_t begin, size_t end) {
+  LangevinJob *job = ctx;
+  ensembleLangevinRange(job->e, job->dt, job->seed, job->step, begin, end);
+}
+
+void ensembleLangevin(Ensemble *e, Pool *pool, double dt, uint64_t seed,
+                      uint64_t step) {
+  LangevinJob job = {.e = e, .dt = dt, .seed = seed, .step = step};
+  poolRun(pool, langevinTask, &job, e->n, 16 * ENSEMBLE_BLOCK);
+}
@@ -0,0 +1,63 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "pendulum.h"
+#include "pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ENSEMBLE_BLOCK 64 // Lanes integrated together by the kernel
+
+/* Many pendulums sharing lengths, masses and gravity, stored as one array
+ * per state variable so the kernel can run across lanes in SIMD registers */
+typedef struct Ensemble {
+  size_t n;
+  double l1, l2;
+  double m1, m2;
+  double g;
+  double gamma; // Viscous damping on both angles (N m s)
+  double kT;    // Thermal energy driving ensembleLangevin() (J)
+
+  double *t1, *t2;
+  double *w1, *w2;
+
+  /* Applied torques per lane, NULL for none. Not owned by the ensemble. */
+  const double *u1, *u2;
+
+  /* Gravity per lane, NULL to use g everywhere. Not owned either. */
+  const double *gravity;
+} Ensemble;
+
+/* Allocate n lanes, each starting in the state of a and b */
+int ensembleInit(Ensemble *e, size_t n, const Body *a, const Body *b);
+void ensembleFree(Ensemble *e);
+
+void ensembleSet(Ensemble *e, size_t i, const Body *a, const Body *b);
+void ensembleGet(const Ensemble *e, size_t i, Body *a, Body *b);
+
+/* Total energy of lanes [begin, end), as getKinetic() + getPotential() */
+void ensembleEnergy(const Ensemble *e, size_t begin, size_t end,
+                    double *energy);
+
+/* Angular accelerations of up to ENSEMBLE_BLOCK states given by the
+ * arrays, with the torques and gravity of lanes [begin, begin + m) */
+void ensembleAccel(const Ensemble *e, size_t begin, size_t m,
+                   const double *t1, const double *t2, const double *w1,
+                   const double *w2, double *a1, double *a2);
+
+/* One RK4 step of lanes [begin, end) */
+void ensembleStepRange(const Ensemble *e, double dt, size_t begin, size_t end);
+
+/* One RK4 step of every lane, split across the pool */
+void ensembleStep(Ensemble *e, Pool *pool, double dt);
+
+/* One stochastic Heun step of lanes [begin, end) with thermal torques of
+ * variance 2 gamma kT / dt on each angle. The noise for lane i at a given
+ * step depends only on (seed, i, step). */
+void ensembleLangevinRange(const Ensemble *e, double dt, uint64_t seed,
+                           uint64_t step, size_t begin, size_t end);
+void ensembleLangevin(Ensemble *e, Pool *pool, double dt, uint64_t seed,
+                      uint64_t step);
+
+#endif
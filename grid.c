@@ -0,0 +1,87 @@
+#include "grid.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+int gridInit(Grid *g, SDL_Renderer *renderer, int size, const Body *a,
+             const Body *b) {
+  memset(g, 0, sizeof(Grid));
+  g->size = size;
+  if (ensembleInit(&g->e, (size_t)size * size, a, b)) {
+    return 1;
+  }
+  g->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                 SDL_TEXTUREACCESS_STREAMING, size, size);
+  if (g->texture == NULL) {
+    ensembleFree(&g->e);
+    return 1;
+  }
+  gridReset(g);
+  return 0;
+}
+
+void gridFree(Grid *g) {
+  SDL_DestroyTexture(g->texture);
+  ensembleFree(&g->e);
+}
+
+void gridReset(Grid *g) {
+  for (int y = 0; y < g->size; y++) {
+    for (int x = 0; x < g->size; x++) {
+      size_t i = (size_t)y * g->size + x;
+      g->e.t1[i] = -M_PI + (x + 0.5) * 2 * M_PI / g->size;
+      g->e.t2[i] = M_PI - (y + 0.5) * 2 * M_PI / g->size;
+      g->e.w1[i] = 0;
+      g->e.w2[i] = 0;
+    }
+  }
+}
+
+typedef struct GridJob {
+  const Grid *g;
+  double dt;
+  uint8_t *pixels;
+  int pitch;
+} GridJob;
+
+/* Red follows the first arm and blue the second, both brightest pointing
+ * up; green follows the angle between them. Periodic in both angles so
+ * wrapping never shows a seam. */
+static void colourRow(const double *t1, const double *t2, int n,
+                      uint32_t *row) {
+  for (int i = 0; i < n; i++) {
+    int r = 127.5 - 127.5 * sin(t1[i] + M_PI_2);
+    int g = 127.5 - 127.5 * sin(t1[i] - t2[i] + M_PI_2);
+    int b = 127.5 - 127.5 * sin(t2[i] + M_PI_2);
+    row[i] = 0xff000000u | r << 16 | g << 8 | b;
+  }
+}
+
+static void gridTask(void *ctx, size_t begin, size_t end) {
+  GridJob *job = ctx;
+  const Grid *g = job->g;
+  size_t size = g->size;
+
+  ensembleStepRange(&g->e, job->dt, begin * size, end * size);
+  for (size_t y = begin; y < end; y++) {
+    colourRow(g->e.t1 + y * size, g->e.t2 + y * size, size,
+              (uint32_t *)(job->pixels + y * job->pitch));
+  }
+}
+
+int gridStep(Grid *g, Pool *pool, double dt) {
+  void *pixels;
+  int pitch;
+  if (SDL_LockTexture(g->texture, NULL, &pixels, &pitch) != 0) {
+    return 1;
+  }
+
+  /* Rows, so that chunks never split one */
+  GridJob job = {.g = g, .dt = dt, .pixels = pixels, .pitch = pitch};
+  size_t grain = (16 * ENSEMBLE_BLOCK + g->size - 1) / g->size;
+  poolRun(pool, gridTask, &job, g->size, grain);
+
+  SDL_UnlockTexture(g->texture);
+  return 0;
+}
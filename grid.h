@@ -0,0 +1,31 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <SDL2/SDL.h>
+
+#include "ensemble.h"
+#include "pendulum.h"
+#include "pool.h"
+
+/* A live (theta1, theta2) grid: one pendulum per texel, started at rest with
+ * theta1 across and theta2 down the grid like --sweep, coloured by where its
+ * arms currently point */
+typedef struct Grid {
+  int size;
+  Ensemble e;
+  SDL_Texture *texture;
+} Grid;
+
+int gridInit(Grid *g, SDL_Renderer *renderer, int size, const Body *a,
+             const Body *b);
+void gridFree(Grid *g);
+
+/* Back to the initial conditions */
+void gridReset(Grid *g);
+
+/* Step every pendulum by dt and write its colour straight into the locked
+ * streaming texture. Each pool chunk colours its rows right after stepping
+ * them, while their state is still in cache. */
+int gridStep(Grid *g, Pool *pool, double dt);
+
+#endif
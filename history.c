@@ -0,0 +1,141 @@
+#include "history.h"
+#include "budget.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int historyInit(History *h, size_t n, int capacity, long interval) {
+  memset(h, 0, sizeof(History));
+  h->n = n;
+  h->capacity = capacity;
+  h->interval = interval;
+  h->states =
+      budgetAlloc(MEM_HISTORY, (size_t)capacity * 4 * n * sizeof(double));
+  h->steps = malloc(capacity * sizeof(long));
+  if (h->states == NULL || h->steps == NULL) {
+    historyFree(h);
+    return 1;
+  }
+  return 0;
+}
+
+void historyFree(History *h) {
+  budgetFree(h->states);
+  free(h->steps);
+  h->states = NULL;
+  h->steps = NULL;
+}
+
+void historyRecord(History *h, const Ensemble *e, long step) {
+  if (step % h->interval && h->count > 0) {
+    return;
+  }
+  size_t n = h->n;
+  double *s = h->states + (size_t)h->head * 4 * n;
+  memcpy(s, e->t1, n * sizeof(double));
+  memcpy(s + n, e->t2, n * sizeof(double));
+  memcpy(s + 2 * n, e->w1, n * sizeof(double));
+  memcpy(s + 3 * n, e->w2, n * sizeof(double));
+  h->steps[h->head] = step;
+  h->head = (h->head + 1) % h->capacity;
+  if (h->count < h->capacity) {
+    h->count++;
+  }
+}
+
+/* Slots are in step order from oldest to newest */
+static int slotAt(const History *h, int k) {
+  return (h->head - h->count + k + h->capacity) % h->capacity;
+}
+
+void historyTruncate(History *h, long step) {
+  while (h->count > 0 && h->steps[slotAt(h, h->count - 1)] > step) {
+    h->head = (h->head - 1 + h->capacity) % h->capacity;
+    h->count--;
+  }
+}
+
+int historyFind(const History *h, long step) {
+  for (int k = h->count - 1; k >= 0; k--) {
+    if (h->steps[slotAt(h, k)] <= step) {
+      return slotAt(h, k);
+    }
+  }
+  return -1;
+}
+
+int seekInit(Seek *s, const Ensemble *like) {
+  Body a = {.l = like->l1, .m = like->m1};
+  Body b = {.l = like->l2, .m = like->m2};
+  memset(s, 0, sizeof(Seek));
+  if (ensembleInit(&s->e, like->n, &a, &b)) {
+    return 1;
+  }
+  s->e.g = like->g;
+  s->e.gravity = like->gravity;
+  return 0;
+}
+
+void seekFree(Seek *s) {
+  seekCancel(s);
+  ensembleFree(&s->e);
+}
+
+/* Same block boundaries as ensembleStep(), so the result matches the live
+ * run bit for bit */
+static void *seekThread(void *arg) {
+  Seek *s = arg;
+  for (long step = s->from; step < s->to; step++) {
+    if (__atomic_load_n(&s->cancel, __ATOMIC_RELAXED)) {
+      return NULL;
+    }
+    ensembleStepRange(&s->e, DT, 0, s->e.n);
+  }
+  __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+int seekStart(Seek *s, const History *h, long to) {
+  int slot = historyFind(h, to);
+  if (slot < 0) {
+    return 1;
+  }
+  seekCancel(s);
+
+  size_t n = h->n;
+  const double *state = h->states + (size_t)slot * 4 * n;
+  memcpy(s->e.t1, state, n * sizeof(double));
+  memcpy(s->e.t2, state + n, n * sizeof(double));
+  memcpy(s->e.w1, state + 2 * n, n * sizeof(double));
+  memcpy(s->e.w2, state + 3 * n, n * sizeof(double));
+  s->from = h->steps[slot];
+  s->to = to;
+  s->done = 0;
+  s->cancel = 0;
+  /* Without a thread to spare, catch up right here */
+  s->running = pthread_create(&s->thread, NULL, seekThread, s) == 0;
+  if (!s->running) {
+    seekThread(s);
+  }
+  return 0;
+}
+
+int seekDone(Seek *s) {
+  if (!__atomic_load_n(&s->done, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+  if (s->running) {
+    pthread_join(s->thread, NULL);
+    s->running = 0;
+  }
+  s->done = 0;
+  return 1;
+}
+
+void seekCancel(Seek *s) {
+  if (s->running) {
+    __atomic_store_n(&s->cancel, 1, __ATOMIC_RELAXED);
+    pthread_join(s->thread, NULL);
+    s->running = 0;
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "ensemble.h"
+
+/* Ensemble states taken every interval steps, keeping the last capacity of
+ * them. Any step they cover can be rebuilt by restoring the snapshot before
+ * it and integrating forward, so memory is capacity * 4 * n doubles however
+ * long the simulation runs. */
+typedef struct History {
+  size_t n;
+  int capacity;
+  long interval;
+  double *states; // capacity snapshots of t1, t2, w1 and w2
+  long *steps;    // Step each slot was taken at
+  int head;       // Next slot to write
+  int count;
+} History;
+
+int historyInit(History *h, size_t n, int capacity, long interval);
+void historyFree(History *h);
+
+/* Snapshot e if step falls on the interval, or if there is none yet */
+void historyRecord(History *h, const Ensemble *e, long step);
+
+/* Forget snapshots taken after step, as the live run now branches there */
+void historyTruncate(History *h, long step);
+
+/* Slot of the newest snapshot at or before step, -1 if there is none */
+int historyFind(const History *h, long step);
+
+/* Rewinding in the background: a copy of the ensemble restored from a
+ * snapshot and stepped on its own thread up to the target, so the viewer
+ * keeps drawing while it catches up */
+typedef struct Seek {
+  Ensemble e;
+  long from, to;
+  int running; // Thread started and not joined yet
+  int done;    // Written by the thread
+  int cancel;  // Written by the viewer
+  pthread_t thread;
+} Seek;
+
+/* like gives the parameters, lane count and gravity of the copy */
+int seekInit(Seek *s, const Ensemble *like);
+void seekFree(Seek *s);
+
+/* Start re-integrating towards step to, cancelling any seek in flight.
+ * Returns 1 if the history doesn't reach back that far. */
+int seekStart(Seek *s, const History *h, long to);
+
+/* 1 once, when a started seek has reached its target. s->e then holds the
+ * state at step s->to. */
+int seekDone(Seek *s);
+void seekCancel(Seek *s);
+
+#endif
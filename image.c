@@ -0,0 +1,290 @@
+#include "image.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define STRIPS_PER_THREAD 2 // In flight at once, bounds memory
+
+static void put32(unsigned char *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static int writeChunk(FILE *f, const char *type, const unsigned char *data,
+                      size_t len) {
+  unsigned char head[8], tail[4];
+  put32(head, (uint32_t)len);
+  memcpy(head + 4, type, 4);
+
+  /* crc32() treats a NULL buffer as a request for the initial value */
+  uLong crc = crc32(0, head + 4, 4);
+  if (len) {
+    crc = crc32(crc, data, len);
+  }
+  put32(tail, (uint32_t)crc);
+
+  return fwrite(head, 1, 8, f) != 8 ||
+         (len && fwrite(data, 1, len, f) != len) || fwrite(tail, 1, 4, f) != 4;
+}
+
+/* Deflate one strip as a raw stream, ending on a byte boundary so strips can
+ * simply be concatenated. The last strip finishes the stream instead. */
+static int compressStrip(PngStrip *s, int last, int level) {
+  z_stream z = {0};
+  if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK) {
+    return 1;
+  }
+
+  size_t cap = deflateBound(&z, s->raw_len) + 16;
+  s->out = malloc(cap);
+  if (s->out == NULL) {
+    deflateEnd(&z);
+    return 1;
+  }
+
+  z.next_in = s->raw;
+  z.avail_in = s->raw_len;
+  z.next_out = s->out;
+  z.avail_out = cap;
+  int ret = deflate(&z, last ? Z_FINISH : Z_FULL_FLUSH);
+  s->out_len = cap - z.avail_out;
+  deflateEnd(&z);
+
+  s->adler = adler32(1, s->raw, s->raw_len);
+  return ret != (last ? Z_STREAM_END : Z_OK);
+}
+
+/* Write out every strip that is ready and next in line. Called with the
+ * lock held. */
+static void drain(PngWriter *w) {
+  for (;;) {
+    PngStrip *s = w->window[w->written % w->max_in_flight];
+    if (s == NULL || !s->ready || s->index != w->written) {
+      return;
+    }
+
+    w->err |= writeChunk(w->f, "IDAT", s->out, s->out_len);
+    w->adler = adler32_combine(w->adler, s->adler, s->raw_len);
+
+    w->window[w->written % w->max_in_flight] = NULL;
+    w->written++;
+    free(s->raw);
+    free(s->out);
+    free(s);
+    pthread_cond_broadcast(&w->space);
+  }
+}
+
+static void *encoder(void *arg) {
+  PngWriter *w = arg;
+
+  pthread_mutex_lock(&w->lock);
+  for (;;) {
+    while (w->queue == NULL && !w->quit) {
+      pthread_cond_wait(&w->work, &w->lock);
+    }
+    if (w->queue == NULL) {
+      break;
+    }
+
+    PngStrip *s = w->queue;
+    w->queue = s->next;
+    if (w->queue == NULL) {
+      w->queue_tail = NULL;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    int err = compressStrip(s, s->last, w->level);
+
+    pthread_mutex_lock(&w->lock);
+    w->err |= err;
+    s->ready = 1;
+    drain(w);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+PngWriter *pngOpen(const char *path, int width, int height, int threads) {
+  if (threads <= 0) {
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  PngWriter *w = calloc(1, sizeof(PngWriter));
+  if (w == NULL) {
+    return NULL;
+  }
+  w->f = fopen(path, "wb");
+  if (w->f == NULL) {
+    free(w);
+    return NULL;
+  }
+
+  w->width = width;
+  w->height = height;
+  w->level = 6;
+  w->adler = adler32(0, NULL, 0);
+  w->max_in_flight = STRIPS_PER_THREAD * threads;
+  w->window = calloc(w->max_in_flight, sizeof(PngStrip *));
+  w->threads = calloc(threads, sizeof(pthread_t));
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->work, NULL);
+  pthread_cond_init(&w->space, NULL);
+
+  /* Signature, 8-bit RGB header, and the zlib header in its own IDAT */
+  unsigned char ihdr[13] = {0};
+  put32(ihdr, width);
+  put32(ihdr + 4, height);
+  ihdr[8] = 8;
+  ihdr[9] = 2;
+  static const unsigned char zlib_header[2] = {0x78, 0x9C};
+
+  w->err |= fwrite("\x89PNG\r\n\x1a\n", 1, 8, w->f) != 8;
+  w->err |= writeChunk(w->f, "IHDR", ihdr, sizeof(ihdr));
+  w->err |= writeChunk(w->f, "IDAT", zlib_header, 2);
+
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&w->threads[i], NULL, encoder, w) != 0) {
+      break;
+    }
+    w->n_threads++;
+  }
+
+  if (w->window == NULL || w->n_threads == 0) {
+    w->err = 1;
+    pngClose(w);
+    return NULL;
+  }
+  return w;
+}
+
+PngStrip *pngStrip(PngWriter *w, int rows) {
+  PngStrip *s = calloc(1, sizeof(PngStrip));
+  if (s == NULL) {
+    return NULL;
+  }
+  s->rows = rows;
+  s->raw_len = (size_t)rows * (1 + 3 * (size_t)w->width);
+  s->raw = malloc(s->raw_len);
+  if (s->raw == NULL) {
+    free(s);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&w->lock);
+  while (w->submitted - w->written >= w->max_in_flight) {
+    pthread_cond_wait(&w->space, &w->lock);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return s;
+}
+
+void pngSubmit(PngWriter *w, PngStrip *s) {
+  pthread_mutex_lock(&w->lock);
+  s->index = w->submitted++;
+  w->rows_submitted += s->rows;
+  s->last = w->rows_submitted >= w->height;
+  w->window[s->index % w->max_in_flight] = s;
+
+  if (w->queue_tail) {
+    w->queue_tail->next = s;
+  } else {
+    w->queue = s;
+  }
+  w->queue_tail = s;
+  pthread_cond_signal(&w->work);
+  pthread_mutex_unlock(&w->lock);
+}
+
+int pngClose(PngWriter *w) {
+  pthread_mutex_lock(&w->lock);
+  w->quit = 1;
+  pthread_cond_broadcast(&w->work);
+  pthread_mutex_unlock(&w->lock);
+
+  for (int i = 0; i < w->n_threads; i++) {
+    pthread_join(w->threads[i], NULL);
+  }
+
+  int err = w->err || w->written != w->submitted ||
+            w->rows_submitted != w->height;
+  if (!err) {
+    unsigned char adler[4];
+    put32(adler, (uint32_t)w->adler);
+    err |= writeChunk(w->f, "IDAT", adler, 4);
+    err |= writeChunk(w->f, "IEND", NULL, 0);
+  }
+  err |= fclose(w->f) != 0;
+
+  pthread_cond_destroy(&w->space);
+  pthread_cond_destroy(&w->work);
+  pthread_mutex_destroy(&w->lock);
+  free(w->window);
+  free(w->threads);
+  free(w);
+  return err;
+}
+
+/* Piecewise-linear through a few stops, black to purple to orange to pale
+ * yellow */
+static uint8_t colormap[256][3];
+static pthread_once_t colormap_once = PTHREAD_ONCE_INIT;
+
+static void buildColormap(void) {
+  static const double stops[][4] = {{0.0, 0, 0, 0},
+                                    {0.25, 60, 15, 110},
+                                    {0.5, 180, 55, 120},
+                                    {0.75, 250, 140, 40},
+                                    {1.0, 252, 250, 190}};
+
+  for (int i = 0; i < 256; i++) {
+    double x = i / 255.0;
+    int k = 0;
+    while (k < 3 && x > stops[k + 1][0]) {
+      k++;
+    }
+    double f = (x - stops[k][0]) / (stops[k + 1][0] - stops[k][0]);
+    for (int c = 0; c < 3; c++) {
+      colormap[i][c] =
+          (uint8_t)(stops[k][c + 1] + f * (stops[k + 1][c + 1] - stops[k][c + 1]) + 0.5);
+    }
+  }
+}
+
+#define MAP_BLOCK 256
+
+/* NAN test on the bits, which -Ofast can't assume away */
+static inline int notFlipped(double t) {
+  uint64_t bits;
+  memcpy(&bits, &t, sizeof(bits));
+  return (bits & 0x7FF0000000000000ULL) == 0x7FF0000000000000ULL;
+}
+
+void colormapFlipTimes(const double *restrict flip_time, size_t n, double dt,
+                       double seconds, uint8_t *restrict rgb) {
+  pthread_once(&colormap_once, buildColormap);
+
+  double scale = 254.0 / log(seconds / dt);
+  int32_t index[MAP_BLOCK];
+
+  for (size_t s = 0; s < n; s += MAP_BLOCK) {
+    size_t m = n - s < MAP_BLOCK ? n - s : MAP_BLOCK;
+
+    /* Indices in a branch-free loop the compiler vectorizes, then the
+     * table lookups */
+    for (size_t i = 0; i < m; i++) {
+      double x = 255.0 - scale * log(fmax(flip_time[s + i], dt) / dt);
+      index[i] = (int32_t)fmin(fmax(x, 1.0), 255.0);
+    }
+    for (size_t i = 0; i < m; i++) {
+      int k = notFlipped(flip_time[s + i]) ? 0 : index[i];
+      memcpy(rgb + 3 * (s + i), colormap[k], 3);
+    }
+  }
+}
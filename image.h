@@ -0,0 +1,71 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Streaming RGB PNG writer for images too big to hold in memory. Rows arrive
+ * in strips; each strip is deflated on its own encoder thread as an
+ * independent stream (ended with a full flush), and the strips are written
+ * out in order as consecutive IDAT chunks, with the zlib checksum stitched
+ * together from the per-strip ones. */
+
+typedef struct PngStrip {
+  int rows;
+  unsigned char *raw; // rows of (filter byte, width * RGB)
+  size_t raw_len;
+  unsigned char *out;
+  size_t out_len;
+  unsigned long adler;
+  int index;
+  int last;
+  int ready;
+  struct PngStrip *next;
+} PngStrip;
+
+typedef struct PngWriter {
+  FILE *f;
+  int width, height;
+  int level;
+  int rows_submitted;
+
+  pthread_t *threads;
+  int n_threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work;  // Strips waiting to be compressed
+  pthread_cond_t space; // A strip was written out
+
+  PngStrip *queue, *queue_tail;
+  PngStrip **window; // Strips in flight, by index % max_in_flight
+  int max_in_flight;
+  int submitted;
+  int written;
+  unsigned long adler;
+  int quit;
+  int err;
+} PngWriter;
+
+PngWriter *pngOpen(const char *path, int width, int height, int threads);
+
+/* Buffer for the next rows rows, to be filled with pngRow() and passed to
+ * pngSubmit(). Blocks while too many strips are in flight. */
+PngStrip *pngStrip(PngWriter *w, int rows);
+static inline uint8_t *pngRow(PngWriter *w, PngStrip *s, int row) {
+  uint8_t *r = s->raw + (size_t)row * (1 + 3 * (size_t)w->width);
+  r[0] = 0; // Filter: none
+  return r + 1;
+}
+void pngSubmit(PngWriter *w, PngStrip *s);
+
+/* Wait for every strip, finish the file and free the writer */
+int pngClose(PngWriter *w);
+
+/* Map flip times through a 256 entry colormap, brightest for the fastest
+ * flips on a log scale from dt to seconds and black for NAN (never flipped),
+ * writing n RGB pixels */
+void colormapFlipTimes(const double *flip_time, size_t n, double dt,
+                       double seconds, uint8_t *rgb);
+
+#endif
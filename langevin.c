@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+#include "langevin.h"
+#include "clock.h"
+#include "ensemble.h"
+#include "rng.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void meanEnergy(const Ensemble *e, double *kinetic, double *potential) {
+  long double k = 0, p = 0;
+  for (size_t i = 0; i < e->n; i++) {
+    Body a, b;
+    ensembleGet(e, i, &a, &b);
+    k += getKinetic(&a, &b);
+    p += getPotential(&a, &b);
+  }
+  *kinetic = k / e->n;
+  *potential = p / e->n;
+}
+
+/* double-pendulum --langevin [--pendulums N] [--steps S] [--gamma GAMMA]
+ *                            [--kT KT] [--seed SEED] [--threads T]
+ *
+ * Thermalizes an ensemble hanging at rest and prints its mean energies,
+ * which should settle to <K> = kT (two degrees of freedom). */
+int langevinMain(int argc, char **argv) {
+  size_t n = 65536;
+  long steps = 5000;
+  int threads = 0;
+  uint64_t seed = 1;
+  double gamma = 0.5;
+  double kT = 1.0;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--pendulums") && i + 1 < argc) {
+      n = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--steps") && i + 1 < argc) {
+      steps = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--gamma") && i + 1 < argc) {
+      gamma = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--kT") && i + 1 < argc) {
+      kT = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    }
+  }
+
+  if (n == 0 || steps <= 0) {
+    printf("Pendulums and steps must be positive\n");
+    return 1;
+  }
+
+  Body a = {.l = 1.0, .m = 1.0, .t = 0.0, .w = 0.0};
+  Body b = {.l = 1.0, .m = 1.0, .t = 0.0, .w = 0.0};
+
+  Ensemble e = {0};
+  Pool *pool = poolCreate(threads);
+  double *z1 = malloc(n * sizeof(double)), *z2 = malloc(n * sizeof(double));
+  int err = 1;
+  if (pool == NULL || !z1 || !z2 || ensembleInit(&e, n, &a, &b) != 0) {
+    printf("Could not allocate %zu pendulums\n", n);
+    goto done;
+  }
+  e.gamma = gamma;
+  e.kT = kT;
+
+  printf("%10s %12s %12s\n", "time", "<kinetic>", "<potential>");
+  double start = nowSeconds();
+  for (long s = 0; s < steps; s++) {
+    ensembleLangevin(&e, pool, DT, seed, s);
+    if ((s + 1) % (steps / 10 ? steps / 10 : 1) == 0) {
+      double k, p;
+      meanEnergy(&e, &k, &p);
+      printf("%10.2f %12.5f %12.5f\n", (s + 1) * DT, k, p);
+    }
+  }
+  double elapsed = nowSeconds() - start;
+
+  /* Cost of the noise alone, for the same number of draws */
+  long rng_steps = steps < 100 ? steps : 100;
+  double rng_start = nowSeconds();
+  for (long s = 0; s < rng_steps; s++) {
+    philoxNormals(seed, 0, s, n, z1, z2);
+  }
+  double rng_elapsed = (nowSeconds() - rng_start) * steps / rng_steps;
+
+  printf("\n%zu pendulums x %ld steps on %d threads: %.2f M steps/s\n", n,
+         steps, pool->n_threads + 1, n * (double)steps / elapsed * 1e-6);
+  printf("noise generation: %.1f%% of single-thread step time\n",
+         100 * rng_elapsed / (elapsed * (pool->n_threads + 1)));
+  err = 0;
+
+done:
+  free(z1);
+  free(z2);
+  ensembleFree(&e);
+  poolDestroy(pool);
+  return err;
+}
@@ -0,0 +1,6 @@
+#ifndef LANGEVIN_H
+#define LANGEVIN_H
+
+int langevinMain(int argc, char **argv);
+
+#endif
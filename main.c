@@ -6,176 +6,246 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "bench.h"
+#include "boundary.h"
+#include "budget.h"
+#include "chaos.h"
+#include "clock.h"
+#include "diff.h"
+#include "e2e.h"
+#include "energy.h"
+#include "grid.h"
+#include "history.h"
+#include "langevin.h"
+#include "metrics.h"
+#include "montecarlo.h"
+#include "mppi.h"
+#include "pendulum.h"
+#include "pool.h"
+#include "preview.h"
+#include "realtime.h"
+#include "render.h"
+#include "run.h"
+#include "splitting.h"
+#include "startup.h"
+#include "sweep.h"
+#include "vecenv.h"
+
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 
 /* Constants */
 #define SCREEN_WIDTH 1000
 #define SCREEN_HEIGHT 800
-#define TRAIL_SIZE 1024
-
-/* Acceleration due to gravity (m/s^2)
- * https://nssdc.gsfc.nasa.gov/planetary/
- * Uncomment one of these
- * */
-// #define G 274.0    // Sun gravity
-// #define G 3.70     // Mercury gravity
-// #define G 8.87     // Venus gravity
-#define G 9.78     // Earth
-// #define G 3.73     // Mars 
-// #define G 23.12    // Jupiter
-// #define G 8.96     // Saturn
-// #define G 8.69     // Uranus
-// #define G 11.00    // Neptune
-// #define G 0.62     // Pluto
-
-// #define G 1.625    // Moon 
-
-
-#define DT 0.01   // Time diff
-
-typedef struct Color {
-  int r;
-  int g;
-  int b;
-  int a;
-} Color;
-
-typedef struct Body {
-  long double l;
-  long double m;
-  long double t;
-  long double w;
-  Color color;
-} Body;
-
-typedef struct Trail {
-  int idx;
-  int n_elements;
-  Color color;
-  SDL_FPoint points[TRAIL_SIZE];
-} Trail;
-
-void appendToTrail(Trail *t, SDL_FPoint pt) {
-  t->points[t->idx++] = pt;
-  t->idx %= TRAIL_SIZE;
-  t->n_elements = MIN(t->n_elements + 1, TRAIL_SIZE);
-}
-
-long double getPotential(Body *a, Body *b) {
-  long double y1 = -a->l * cosl(a->t);
-  long double y2 = y1 - b->l * cosl(b->t);
-
-  return a->m * G * y1 + b->m * G * y2;
-}
-
-long double getKinetic(Body *a, Body *b) {
-  long double av2 = pow(a->l * a->w, 2);
-  long double bv2 = pow(b->l * b->w, 2);
-
-  long double k1 = 0.5 * a->m * av2;
-  long double k2 =
-      0.5 * b->m *
-      (av2 + bv2 + 2 * a->l * b->l * a->w * b->w * cosl(a->t - b->t));
-
-  return k1 + k2;
+#define GRAB_PIXELS 12 // How close to a bob a click picks it up
+
+/* Every lane at rest at (t1, t2), with theta1 spread evenly over spread
+ * radians within each group of n */
+static void pose(Ensemble *e, size_t n, double spread, double t1,
+                 double t2) {
+  for (size_t i = 0; i < e->n; i++) {
+    e->t1[i] = n > 1 ? t1 + spread * ((double)(i % n) / (n - 1) - 0.5) : t1;
+    e->t2[i] = t2;
+    e->w1[i] = 0;
+    e->w2[i] = 0;
+  }
 }
 
-void lagrange(Body *a, Body *b, long double *k, long double *y) {
-
-  long double b_a = (b->l / a->l);
-  long double a_b = (a->l / b->l);
-  long double total_mass = (a->m + b->m);
-
-  long double accel_1 = b_a * (b->m / total_mass) * cosl(y[0] - y[1]);
-  long double accel_2 = a_b * cosl(y[0] - y[1]);
-
-  long double force_1 =
-      -b_a * (b->m / total_mass) * (y[3] * y[3]) * sinl(y[0] - y[1]) -
-      (G / a->l) * sinl(y[0]);
-  long double force_2 =
-      a_b * (a->w * a->w) * sinl(y[0] - y[1]) - (G / b->l) * sinl(y[1]);
-
-  long double g1 = (force_1 - accel_1 * force_2) / (1 - accel_1 * accel_2);
-  long double g2 = (force_2 - accel_2 * force_1) / (1 - accel_1 * accel_2);
-
-  k[0] = y[2];
-  k[1] = y[3];
-  k[2] = g1;
-  k[3] = g2;
+/* Input for frame f of a --script session of frames frames: a jump back,
+ * a drag of the first pendulum's tip around its elbow, zooming and panning,
+ * then quitting. Pushed events go through the same handlers as real ones. */
+static void script(int f, int frames, const View *v, const Ensemble *e) {
+  SDL_Event event = {0};
+  int drag = frames / 2;
+  if (f >= frames) {
+    event.type = SDL_QUIT;
+  } else if (f == frames / 4) {
+    event.type = SDL_KEYDOWN;
+    event.key.keysym.sym = SDLK_LEFT;
+  } else if (f >= drag && f <= drag + 20) {
+    /* Screen position of the tip, swung a little further each frame */
+    double t2 = e->t2[0] + (f > drag ? 0.1 : 0);
+    double wx = e->l1 * sin(e->t1[0]) + e->l2 * sin(t2);
+    double wy = e->l1 * cos(e->t1[0]) + e->l2 * cos(t2);
+    int x = lround(v->rect.x + v->rect.w / 2.0 + (wx - v->cx) * v->scale);
+    int y = lround(v->rect.y + v->rect.h / 2.0 + (wy - v->cy) * v->scale);
+    if (f == drag) {
+      event.type = SDL_MOUSEBUTTONDOWN;
+      event.button.button = SDL_BUTTON_LEFT;
+      event.button.x = x;
+      event.button.y = y;
+    } else if (f < drag + 20) {
+      event.type = SDL_MOUSEMOTION;
+      event.motion.state = SDL_BUTTON_LMASK;
+      event.motion.x = x;
+      event.motion.y = y;
+    } else {
+      event.type = SDL_MOUSEBUTTONUP;
+      event.button.button = SDL_BUTTON_LEFT;
+    }
+  } else if (f > frames * 3 / 4 && f < frames * 3 / 4 + 10) {
+    event.type = SDL_MOUSEWHEEL;
+    event.wheel.y = 1;
+  } else if (f > frames * 3 / 4 + 10 && f < frames * 3 / 4 + 30) {
+    event.type = SDL_MOUSEMOTION;
+    event.motion.state = SDL_BUTTON_LMASK;
+    event.motion.x = v->rect.x + v->rect.w / 2;
+    event.motion.y = v->rect.y + v->rect.h / 2;
+    event.motion.xrel = 5;
+    event.motion.yrel = 3;
+  }
+  if (event.type) {
+    SDL_PushEvent(&event);
+  }
 }
 
-void updatePositions(Body *a, Body *b) {
-  long double y[4] = {a->t, b->t, a->w, b->w};
-  long double k1[4], k2[4], k3[4], k4[4];
-  long double tmp[4];
-
-  lagrange(a, b, k1, y);
-
-  tmp[0] = y[0] + DT * k1[0] / 2;
-  tmp[1] = y[1] + DT * k1[1] / 2;
-  tmp[2] = y[2] + DT * k1[2] / 2;
-  tmp[3] = y[3] + DT * k1[3] / 2;
-  lagrange(a, b, k2, tmp);
-
-  tmp[0] = y[0] + DT * k2[0] / 2;
-  tmp[1] = y[1] + DT * k2[1] / 2;
-  tmp[2] = y[2] + DT * k2[2] / 2;
-  tmp[3] = y[3] + DT * k2[3] / 2;
-  lagrange(a, b, k3, tmp);
-
-  tmp[0] = y[0] + DT * k3[0];
-  tmp[1] = y[1] + DT * k3[1];
-  tmp[2] = y[2] + DT * k3[2];
-  tmp[3] = y[3] + DT * k3[3];
-  lagrange(a, b, k4, tmp);
-
-  a->t += 1.0 / 6.0 * DT * (k1[0] + 2.0 * k2[0] + 2.0 * k3[0] + k4[0]);
-  b->t += 1.0 / 6.0 * DT * (k1[1] + 2.0 * k2[1] + 2.0 * k3[1] + k4[1]);
-  a->w += 1.0 / 6.0 * DT * (k1[2] + 2.0 * k2[2] + 2.0 * k3[2] + k4[2]);
-  b->w += 1.0 / 6.0 * DT * (k1[3] + 2.0 * k2[3] + 2.0 * k3[3] + k4[3]);
+/* Headless modes never touch SDL. Returns -1 if argv names none. */
+static int headless(int argc, char **argv) {
+  if (argc > 1 && !strcmp(argv[1], "--realtime")) {
+    return realtimeMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--mppi")) {
+    return mppiMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--vecenv")) {
+    return vecEnvMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--langevin")) {
+    return langevinMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--montecarlo")) {
+    return monteCarloMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--splitting")) {
+    return splittingMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--run")) {
+    return runMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--sweep")) {
+    return sweepMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--diff")) {
+    return diffMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--boundary")) {
+    return boundaryMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--chaos")) {
+    return chaosMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--bench")) {
+    return benchMain(argc - 2, argv + 2);
+  }
+  if (argc > 1 && !strcmp(argv[1], "--bench-e2e")) {
+    return e2eMain(argc - 2, argv + 2);
+  }
+  return -1;
 }
 
-void draw(SDL_Renderer *renderer, Body *a, Body *b, Trail *t) {
+int main(int argc, char **argv) {
+  Startup startup;
+  startupBegin(&startup);
 
-  int size = 0.8 * MIN(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
-  long double total_len = a->l + b->l;
-
-  long double length_a = size * (a->l / total_len);
-  long double length_b = size * (b->l / total_len);
-
-  int cx = SCREEN_WIDTH / 2;
-  int cy = SCREEN_HEIGHT / 2;
-
-  int ax = cx + (int)length_a * sinl(a->t);
-  int ay = cy + (int)length_a * cosl(a->t);
-
-  int bx = ax + (int)length_b * sinl(b->t);
-  int by = ay + (int)length_b * cosl(b->t);
-
-  // Handle trail
-  SDL_FPoint tip = {.x = bx, .y = by};
-  appendToTrail(t, tip);
-
-  /* First segment */
-  SDL_SetRenderDrawColor(renderer, a->color.r, a->color.g, a->color.b,
-                         a->color.a);
-  SDL_RenderDrawLine(renderer, cx, cy, ax, ay);
+  /* Any headless mode can export metrics while it runs */
+  MetricsConfig metrics = {0};
+  argc = metricsOptions(&metrics, argc, argv);
+  if ((metrics.file || metrics.socket) && metricsStart(&metrics)) {
+    printf("Could not start exporting metrics\n");
+    return 1;
+  }
 
-  /* Second segment */
-  SDL_SetRenderDrawColor(renderer, b->color.r, b->color.g, b->color.b,
-                         b->color.a);
-  SDL_RenderDrawLine(renderer, ax, ay, bx, by);
+  /* Size buffers to --memory-budget or the cgroup's limit */
+  argc = budgetOptions(argc, argv);
+
+  /* --energy reports what a headless run cost, where RAPL can be read */
+  int energy = 0;
+  int kept = 0;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--energy")) {
+      energy = 1;
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+  EnergyMeter meter = {0};
+  if (energy) {
+    energyOpen(&meter);
+  }
+  uint64_t steps = metricsCounter(COUNTER_STEPS);
+  double start = nowSeconds();
+  energyStart(&meter);
+
+  int err = headless(argc, argv);
+  metricsStop();
+  if (err >= 0) {
+    double joules = energyStop(&meter);
+    double elapsed = nowSeconds() - start;
+    steps = metricsCounter(COUNTER_STEPS) - steps;
+    if (energy) {
+      printf("%.4g pendulum steps in %.3f s, %.4g steps/s\n", (double)steps,
+             elapsed, steps / elapsed);
+    }
+    if (energy && joules >= 0) {
+      printf("%.4g J, %.4g nJ/step, %.4g J per simulated second\n", joules,
+             joules / steps * 1e9, joules / steps / DT);
+    } else if (energy) {
+      printf("No readable RAPL counters, energy not measured\n");
+    }
+    budgetReport();
+    return err;
+  }
 
-  /* Trail */
-  SDL_SetRenderDrawColor(renderer, t->color.r, t->color.g, t->color.b,
-                         t->color.a);
-  SDL_RenderDrawPointsF(renderer, t->points, t->n_elements);
-}
+  /* Viewer options: --pendulums N starts N pendulums with theta1 spread
+   * evenly over --spread radians around the default, --scenes S repeats
+   * them in S side by side scenes down the list of gravities, and --grid
+   * SIZE shows a SIZE x SIZE grid of starting angles instead. --history
+   * SECONDS of snapshots are kept every --snapshot-every seconds for
+   * rewinding. --script FRAMES plays scripted input unpaced for FRAMES
+   * frames and reports the frame times, for benchmarks. */
+  size_t n = 1;
+  double spread = 1e-3;
+  int scenes = 0;
+  int grid_size = 0;
+  int threads = 0;
+  double history_seconds = 60;
+  double snapshot_every = 1;
+  int script_frames = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--pendulums") && i + 1 < argc) {
+      n = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--spread") && i + 1 < argc) {
+      spread = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--scenes") && i + 1 < argc) {
+      scenes = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--grid") && i + 1 < argc) {
+      grid_size = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--history") && i + 1 < argc) {
+      history_seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--snapshot-every") && i + 1 < argc) {
+      snapshot_every = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--script") && i + 1 < argc) {
+      script_frames = atoi(argv[++i]);
+    }
+  }
+  if (n == 0 || scenes < 0 || grid_size < 0 || script_frames < 0) {
+    printf("--pendulums, --scenes, --grid and --script must be positive\n");
+    return 1;
+  }
+  long interval = lround(snapshot_every / DT);
+  int capacity = (int)(history_seconds / snapshot_every) + 1;
+  if (interval <= 0 || history_seconds < 0) {
+    printf("--snapshot-every must be at least %g\n", DT);
+    return 1;
+  }
+  int n_views = scenes ? scenes : 1;
 
-int main() {
   SDL_Window *window = NULL;
   SDL_Renderer *renderer = NULL;
 
@@ -184,6 +254,7 @@ int main() {
     printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
     return 1;
   }
+  startupMark(&startup, "SDL");
 
   // Create window
   window = SDL_CreateWindow("Double Pendulum", SDL_WINDOWPOS_CENTERED,
@@ -200,6 +271,7 @@ int main() {
     printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
     return 1;
   }
+  startupMark(&startup, "window");
 
   Body a1 = {.l = 1.0,
              .m = 1.0,
@@ -213,56 +285,284 @@ int main() {
              .w = 0.0,
              .color = {.r = 166, .g = 227, .b = 161, .a = 255}};
 
-  Trail t1 = {.n_elements = 0,
-              .idx = 0,
-              .color = {.r = 203, .g = 166, .b = 247, .a = 255}};
-
-  // Body a2 = {.l = 1.0,
-  //            .m = 1.0,
-  //            .t = 1.81,
-  //            .w = 0.0,
-  //            .color = {.r = 243, .g = 139, .b = 168, .a = 255}};
-  //
-  // Body b2 = {.l = 1.0,
-  //            .m = 1.0,
-  //            .t = 1.0,
-  //            .w = 0.0,
-  //            .color = {.r = 243, .g = 139, .b = 168, .a = 255}};
-  //
-  // Trail t2 = {.n_elements = 0,
-  //             .idx = 0,
-  //             .color = {.r = 243, .g = 139, .b = 168, .a = 255}};
-  //
-  int i = 0;
+  /* Every scene is a slice of one ensemble, so they step together */
+  Ensemble e;
+  double *gravity = malloc(n * n_views * sizeof(double));
+  if (gravity == NULL || ensembleInit(&e, n * n_views, &a1, &b1)) {
+    printf("Could not allocate %zu pendulums\n", n * n_views);
+    return 1;
+  }
+  for (size_t i = 0; i < e.n; i++) {
+    gravity[i] = scenes ? gravities[i / n % N_GRAVITIES].g : G;
+  }
+  e.gravity = gravity;
+  pose(&e, n, spread, a1.t, b1.t);
+  Pool *pool = poolCreate(threads);
+
+  /* Left and right jump back and forward 5 s. The state is rebuilt from the
+   * last snapshot on a worker thread while the current frame stays up.
+   *
+   * Dragging a bob of a scene's first pendulum pauses the run and poses
+   * every pendulum there, while a worker thread traces where that start
+   * and a ring of nudged copies go over the next 10 s.
+   *
+   * Neither is needed for the first frame, so both are set up in the
+   * background. The run steps meanwhile, and the first snapshot is taken at
+   * whatever step it has reached once they are ready. */
+  Deferred deferred;
+  History *history = &deferred.history;
+  Seek *seek = &deferred.seek;
+  Preview *preview = &deferred.preview;
+  int ready = 0;
+  long step = 0;
+  int dragging = 0; // 1 for the elbow, 2 for the tip
+  View *drag_view = NULL;
+  size_t drag_lane = 0;
+  double drag_t1 = a1.t, drag_t2 = b1.t;
+  if (deferredStart(&deferred, &e, capacity, interval)) {
+    printf("Could not start the setup thread\n");
+    return 1;
+  }
+
+  Canvas canvas;
+  if (canvasInit(&canvas, renderer, e.n, scenes ? n : 1)) {
+    printf("Could not allocate the canvas\n");
+    return 1;
+  }
+  canvas.background = (Color){.r = 17, .g = 17, .b = 27, .a = 255};
+  canvas.arm1 = a1.color;
+  canvas.arm2 = b1.color;
+  canvas.trail = (Color){.r = 203, .g = 166, .b = 247, .a = 255};
+  canvas.border = (Color){.r = 69, .g = 71, .b = 90, .a = 255};
+
+  /* Scroll to zoom at the cursor, drag to pan, 0 to reset. With scenes
+   * these act on the scene under the cursor. */
+  SDL_Rect screen = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+  View *views = malloc(n_views * sizeof(View));
+  if (views == NULL) {
+    printf("Could not allocate %d views\n", n_views);
+    return 1;
+  }
+  viewLayout(views, n_views, screen, e.l1, e.l2);
+  canvas.trail_tolerance = 0.5 / views[0].scale; // Half a pixel unzoomed
+
+  /* The grid is scaled to the largest centred square, r restarts it */
+  Grid grid;
+  SDL_Rect square = {(SCREEN_WIDTH - MIN(SCREEN_WIDTH, SCREEN_HEIGHT)) / 2,
+                     (SCREEN_HEIGHT - MIN(SCREEN_WIDTH, SCREEN_HEIGHT)) / 2,
+                     MIN(SCREEN_WIDTH, SCREEN_HEIGHT),
+                     MIN(SCREEN_WIDTH, SCREEN_HEIGHT)};
+  if (grid_size && gridInit(&grid, renderer, grid_size, &a1, &b1)) {
+    printf("Could not allocate a %dx%d grid\n", grid_size, grid_size);
+    return 1;
+  }
+  startupMark(&startup, "state");
+  Uint64 frame_start = SDL_GetPerformanceCounter();
+  int frames = 0;
+  Uint64 script_start = frame_start;
+  double worst_frame = 0;
+  int scripted = 0;
+  int first_frame = 1;
+
   SDL_Event event;
   int quit = 0;
 
   while (!quit) {
+    Uint64 frame_begin = SDL_GetPerformanceCounter();
+    if (script_frames) {
+      script(scripted, script_frames, &views[0], &e);
+    }
     while (SDL_PollEvent(&event) != 0) {
       if (event.type == SDL_QUIT) {
         quit = 1;
+      } else if (event.type == SDL_MOUSEWHEEL) {
+        int x, y;
+        SDL_GetMouseState(&x, &y);
+        View *v = viewAt(views, n_views, x, y);
+        if (v) {
+          viewZoom(v, pow(1.25, event.wheel.y), x, y);
+        }
+      } else if (event.type == SDL_MOUSEBUTTONDOWN &&
+                 event.button.button == SDL_BUTTON_LEFT && !grid_size &&
+                 ready) {
+        View *v = viewAt(views, n_views, event.button.x, event.button.y);
+        if (v == NULL) {
+          continue;
+        }
+        size_t lane = (v - views) * n;
+        double wx, wy;
+        viewWorld(v, event.button.x, event.button.y, &wx, &wy);
+        double ex = e.l1 * sin(e.t1[lane]), ey = e.l1 * cos(e.t1[lane]);
+        double tx = ex + e.l2 * sin(e.t2[lane]);
+        double ty = ey + e.l2 * cos(e.t2[lane]);
+        double grab = GRAB_PIXELS / v->scale;
+        if (hypot(wx - tx, wy - ty) < grab) {
+          dragging = 2;
+        } else if (hypot(wx - ex, wy - ey) < grab) {
+          dragging = 1;
+        }
+        if (dragging) {
+          seekCancel(seek);
+          drag_view = v;
+          drag_lane = lane;
+          drag_t1 = e.t1[lane];
+          drag_t2 = e.t2[lane];
+          previewRequest(preview, drag_t1, drag_t2, gravity[lane]);
+        }
+      } else if (event.type == SDL_MOUSEMOTION &&
+                 (event.motion.state & SDL_BUTTON_LMASK) && dragging) {
+        double wx, wy;
+        viewWorld(drag_view, event.motion.x, event.motion.y, &wx, &wy);
+        if (dragging == 1) {
+          drag_t1 = atan2(wx, wy);
+        } else {
+          drag_t2 = atan2(wx - e.l1 * sin(drag_t1), wy - e.l1 * cos(drag_t1));
+        }
+        pose(&e, n, spread, drag_t1, drag_t2);
+        previewRequest(preview, drag_t1, drag_t2, gravity[drag_lane]);
+      } else if (event.type == SDL_MOUSEBUTTONUP &&
+                 event.button.button == SDL_BUTTON_LEFT && dragging) {
+        /* The run starts over from the new pose */
+        dragging = 0;
+        step = 0;
+        historyTruncate(history, -1);
+        historyRecord(history, &e, step);
+        canvasClearTrails(&canvas);
+      } else if (event.type == SDL_MOUSEMOTION &&
+                 (event.motion.state & SDL_BUTTON_LMASK)) {
+        View *v = viewAt(views, n_views, event.motion.x, event.motion.y);
+        if (v) {
+          viewPan(v, event.motion.xrel, event.motion.yrel);
+        }
+      } else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_0) {
+        viewLayout(views, n_views, screen, e.l1, e.l2);
+      } else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_r &&
+                 grid_size) {
+        gridReset(&grid);
+      } else if (event.type == SDL_KEYDOWN &&
+                 (event.key.keysym.sym == SDLK_LEFT ||
+                  event.key.keysym.sym == SDLK_RIGHT) &&
+                 !grid_size && !dragging && ready) {
+        /* Presses during a seek add to its target */
+        long from = seek->running ? seek->to : step;
+        long jump = lround(5 / DT);
+        long to = event.key.keysym.sym == SDLK_LEFT ? from - jump : from + jump;
+        if (seekStart(seek, history, to < 0 ? 0 : to) == 0) {
+          char title[64];
+          snprintf(title, sizeof(title), "Double Pendulum - seeking %.1f s",
+                   seek->to * DT);
+          SDL_SetWindowTitle(window, title);
+        }
       }
     }
 
+    if (ready && seekDone(seek)) {
+      Ensemble live = e;
+      e.t1 = seek->e.t1;
+      e.t2 = seek->e.t2;
+      e.w1 = seek->e.w1;
+      e.w2 = seek->e.w2;
+      seek->e.t1 = live.t1;
+      seek->e.t2 = live.t2;
+      seek->e.w1 = live.w1;
+      seek->e.w2 = live.w2;
+      step = seek->to;
+      historyTruncate(history, step - 1);
+      historyRecord(history, &e, step);
+      canvasClearTrails(&canvas);
+      SDL_SetWindowTitle(window, "Double Pendulum");
+    }
+
     // Clear the screen
-    SDL_SetRenderDrawColor(renderer, 17, 17, 27, 255);
+    SDL_SetRenderDrawColor(renderer, canvas.background.r, canvas.background.g,
+                           canvas.background.b, canvas.background.a);
     SDL_RenderClear(renderer);
 
-    updatePositions(&a1, &b1);
-    // updatePositions(&a2, &b2);
-    draw(renderer, &a1, &b1, &t1);
-    // draw(renderer, &a2, &b2, &t2);
+    if (grid_size) {
+      /* Stepping a million pendulums paces the frames by itself */
+      gridStep(&grid, pool, DT);
+      SDL_RenderCopy(renderer, grid.texture, NULL, &square);
+    } else {
+      /* Paused while a seek catches up or a bob is held */
+      if ((!ready || !seek->running) && !dragging) {
+        ensembleStep(&e, pool, DT);
+        step++;
+        if (ready) {
+          historyRecord(history, &e, step);
+        }
+        canvasTrails(&canvas, &e);
+      }
+      if (scenes) {
+        canvasDrawScenes(&canvas, views, scenes, n, &e);
+      } else {
+        canvasDraw(&canvas, &views[0], &e);
+      }
+      const SDL_FPoint *paths = dragging ? previewPaths(preview) : NULL;
+      if (paths) {
+        canvasDrawPaths(&canvas, drag_view, paths, PREVIEW_LANES,
+                        PREVIEW_STEPS);
+      }
+    }
 
-    i++;
     // Update the screen
     SDL_RenderPresent(renderer);
-    SDL_Delay(10);
+    if (first_frame) {
+      startupMark(&startup, "first frame");
+      startupReport(&startup);
+      first_frame = 0;
+    }
+    if (!ready) {
+      ready = deferredReady(&deferred);
+      if (ready < 0) {
+        printf("%s\n", deferred.error);
+        return 1;
+      } else if (ready) {
+        historyRecord(history, &e, step);
+        printf("Rewinding ready after %.1f ms, %.1f ms of it in the "
+               "background\n",
+               (nowSeconds() - startup.begin) * 1e3, deferred.seconds * 1e3);
+      }
+    }
+    if (script_frames) {
+      Uint64 now = SDL_GetPerformanceCounter();
+      double took = (double)(now - frame_begin) / SDL_GetPerformanceFrequency();
+      worst_frame = took > worst_frame ? took : worst_frame;
+      scripted++;
+    } else if (!grid_size) {
+      SDL_Delay(10);
+    } else if (++frames == 60) {
+      Uint64 now = SDL_GetPerformanceCounter();
+      char title[64];
+      snprintf(title, sizeof(title), "Double Pendulum - %.1f fps",
+               frames * (double)SDL_GetPerformanceFrequency() /
+                   (now - frame_start));
+      SDL_SetWindowTitle(window, title);
+      frame_start = now;
+      frames = 0;
+    }
+  }
+
+  if (script_frames) {
+    double took = (double)(SDL_GetPerformanceCounter() - script_start) /
+                  SDL_GetPerformanceFrequency();
+    printf("%d frames in %.3f s, %.3f ms mean, %.3f ms worst\n", scripted,
+           took, took / scripted * 1e3, worst_frame * 1e3);
   }
 
   // Cleanup
+  if (grid_size) {
+    gridFree(&grid);
+  }
+  deferredFree(&deferred);
+  canvasFree(&canvas);
+  poolDestroy(pool);
+  ensembleFree(&e);
+  free(gravity);
+  free(views);
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
   SDL_Quit();
+  budgetReport();
 
   return 0;
 }
@@ -0,0 +1,231 @@
+#include "metrics.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef union MetricsSlot {
+  uint64_t counters[N_COUNTERS];
+  char line[64];
+} MetricsSlot;
+
+static MetricsSlot slots[METRICS_THREADS] __attribute__((aligned(64)));
+static int n_slots;
+static __thread MetricsSlot *slot;
+
+static uint64_t gauges[N_GAUGES]; // Bits of doubles
+
+/* Held while the pipeline is read, so it can't end under the exporter */
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static const Pipeline *watched;
+
+static const struct {
+  const char *name, *help;
+} counters[N_COUNTERS] = {
+    {"steps_total", "Pendulum steps integrated, one per lane"},
+    {"lagrange_evaluations_total", "Evaluations of the equations of motion"},
+    {"tiles_total", "Sweep tiles finished"},
+    {"written_bytes_total", "Output bytes written"},
+};
+
+static const struct {
+  const char *name, *help;
+} gauge_info[N_GAUGES] = {
+    {"energy_drift", "Relative energy error of the last recorded state"},
+};
+
+void metricsAdd(Counter c, uint64_t n) {
+  if (slot == NULL) {
+    /* Threads past the last slot share it */
+    int k = __atomic_fetch_add(&n_slots, 1, __ATOMIC_RELAXED);
+    slot = &slots[k < METRICS_THREADS ? k : METRICS_THREADS - 1];
+  }
+  __atomic_fetch_add(&slot->counters[c], n, __ATOMIC_RELAXED);
+}
+
+uint64_t metricsCounter(Counter c) {
+  uint64_t sum = 0;
+  for (int k = 0; k < METRICS_THREADS; k++) {
+    sum += __atomic_load_n(&slots[k].counters[c], __ATOMIC_RELAXED);
+  }
+  return sum;
+}
+
+void metricsSet(Gauge g, double v) {
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  __atomic_store_n(&gauges[g], bits, __ATOMIC_RELAXED);
+}
+
+void metricsWatch(const Pipeline *p) {
+  pthread_mutex_lock(&watch_lock);
+  watched = p;
+  pthread_mutex_unlock(&watch_lock);
+}
+
+static void writeMetrics(FILE *f) {
+  for (int c = 0; c < N_COUNTERS; c++) {
+    fprintf(f, "# HELP double_pendulum_%s %s\n", counters[c].name,
+            counters[c].help);
+    fprintf(f, "# TYPE double_pendulum_%s counter\n", counters[c].name);
+    fprintf(f, "double_pendulum_%s %llu\n", counters[c].name,
+            (unsigned long long)metricsCounter(c));
+  }
+  for (int g = 0; g < N_GAUGES; g++) {
+    uint64_t bits = __atomic_load_n(&gauges[g], __ATOMIC_RELAXED);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    fprintf(f, "# HELP double_pendulum_%s %s\n", gauge_info[g].name,
+            gauge_info[g].help);
+    fprintf(f, "# TYPE double_pendulum_%s gauge\n", gauge_info[g].name);
+    fprintf(f, "double_pendulum_%s %.9g\n", gauge_info[g].name, v);
+  }
+
+  pthread_mutex_lock(&watch_lock);
+  const Pipeline *p = watched;
+  if (p == NULL || !__atomic_load_n(&p->running, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_unlock(&watch_lock);
+    return;
+  }
+  fprintf(f, "# HELP double_pendulum_queue_depth Items waiting for a stage\n"
+             "# TYPE double_pendulum_queue_depth gauge\n");
+  for (int k = 0; k < p->n_stages; k++) {
+    const Queue *q = &p->queues[k];
+    size_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    size_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    fprintf(f, "double_pendulum_queue_depth{stage=\"%s\"} %zu\n",
+            p->stages[k].name, tail - head);
+  }
+  fprintf(f, "# HELP double_pendulum_stage_items_total Items through a stage\n"
+             "# TYPE double_pendulum_stage_items_total counter\n");
+  for (int k = 0; k < p->n_stages; k++) {
+    fprintf(f, "double_pendulum_stage_items_total{stage=\"%s\"} %ld\n",
+            p->stages[k].name,
+            __atomic_load_n(&p->stages[k].stats.items, __ATOMIC_RELAXED));
+  }
+  pthread_mutex_unlock(&watch_lock);
+}
+
+static struct {
+  MetricsConfig cfg;
+  pthread_t thread;
+  int listener;
+  int quit;
+  int running;
+} exporter = {.listener = -1};
+
+/* Write to a temporary file and rename it over the old one, so the node
+ * exporter never reads half a file */
+static void writeFile(const char *path) {
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *f = fopen(tmp, "w");
+  if (f == NULL) {
+    return;
+  }
+  writeMetrics(f);
+  if (fclose(f) == 0) {
+    rename(tmp, path);
+  }
+}
+
+static void *exporterThread(void *arg) {
+  (void)arg;
+  int ms = exporter.cfg.interval * 1000;
+  struct pollfd pfd = {.fd = exporter.listener, .events = POLLIN};
+
+  while (!__atomic_load_n(&exporter.quit, __ATOMIC_ACQUIRE)) {
+    if (exporter.cfg.file) {
+      writeFile(exporter.cfg.file);
+    }
+
+    /* Serve connections until it's time to write the file again, waking
+     * every 100 ms to check for quit */
+    for (int waited = 0; waited < ms &&
+                         !__atomic_load_n(&exporter.quit, __ATOMIC_ACQUIRE);
+         waited += 100) {
+      if (exporter.listener < 0) {
+        usleep(100000);
+      } else if (poll(&pfd, 1, 100) > 0) {
+        int fd = accept(exporter.listener, NULL, NULL);
+        FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (f) {
+          writeMetrics(f);
+          fclose(f);
+        } else if (fd >= 0) {
+          close(fd);
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+int metricsOptions(MetricsConfig *cfg, int argc, char **argv) {
+  int n = 0;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc) {
+      cfg->file = argv[++i];
+    } else if (!strcmp(argv[i], "--metrics-socket") && i + 1 < argc) {
+      cfg->socket = argv[++i];
+    } else if (!strcmp(argv[i], "--metrics-interval") && i + 1 < argc) {
+      cfg->interval = atof(argv[++i]);
+    } else {
+      argv[n++] = argv[i];
+    }
+  }
+  return n;
+}
+
+int metricsStart(const MetricsConfig *cfg) {
+  exporter.cfg = *cfg;
+  if (exporter.cfg.interval <= 0) {
+    exporter.cfg.interval = 10;
+  }
+
+  if (cfg->socket) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(cfg->socket) >= sizeof(addr.sun_path)) {
+      return 1;
+    }
+    strcpy(addr.sun_path, cfg->socket);
+    unlink(cfg->socket);
+    exporter.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (exporter.listener < 0 ||
+        bind(exporter.listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(exporter.listener, 8) != 0) {
+      if (exporter.listener >= 0) {
+        close(exporter.listener);
+        exporter.listener = -1;
+      }
+      return 1;
+    }
+  }
+
+  exporter.quit = 0;
+  exporter.running =
+      pthread_create(&exporter.thread, NULL, exporterThread, NULL) == 0;
+  return !exporter.running;
+}
+
+void metricsStop(void) {
+  if (!exporter.running) {
+    return;
+  }
+  __atomic_store_n(&exporter.quit, 1, __ATOMIC_RELEASE);
+  pthread_join(exporter.thread, NULL);
+  exporter.running = 0;
+
+  if (exporter.cfg.file) {
+    writeFile(exporter.cfg.file);
+  }
+  if (exporter.listener >= 0) {
+    close(exporter.listener);
+    unlink(exporter.cfg.socket);
+    exporter.listener = -1;
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "pipeline.h"
+
+#define METRICS_THREADS 64 // Threads with counters of their own
+
+typedef enum Counter {
+  COUNTER_STEPS,    // Pendulum steps integrated, one per lane
+  COUNTER_LAGRANGE, // Evaluations of the equations of motion
+  COUNTER_TILES,    // Sweep tiles finished
+  COUNTER_BYTES,    // Output bytes written
+  N_COUNTERS
+} Counter;
+
+typedef enum Gauge {
+  GAUGE_ENERGY_DRIFT, // |E - E0| / |E0| of the last recorded state
+  N_GAUGES
+} Gauge;
+
+/* Every thread adds to counters on a cache line of its own, and they are
+ * only summed when read, so counting costs the hot path one uncontended
+ * add */
+void metricsAdd(Counter c, uint64_t n);
+uint64_t metricsCounter(Counter c);
+void metricsSet(Gauge g, double v);
+
+/* Report queue depths and stage stats of p too, NULL to stop. Once that
+ * returns, the exporter is done with p. */
+void metricsWatch(const Pipeline *p);
+
+/* Export in the Prometheus text format by rewriting a node exporter
+ * textfile every interval seconds, and/or to anyone who connects to a Unix
+ * socket */
+typedef struct MetricsConfig {
+  const char *file;
+  const char *socket;
+  double interval;
+} MetricsConfig;
+
+/* Take --metrics-file, --metrics-socket and --metrics-interval out of
+ * argv, returning the new argc */
+int metricsOptions(MetricsConfig *cfg, int argc, char **argv);
+
+int metricsStart(const MetricsConfig *cfg);
+
+/* Write the file one last time and stop serving */
+void metricsStop(void);
+
+#endif
@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include "montecarlo.h"
+#include "budget.h"
+#include "ensemble.h"
+#include "rng.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_PER_STRATUM 2 // Every stratum keeps sampling a little
+#define PILOT 16          // Samples a stratum needs before we trust it
+
+void monteCarloDefaults(MonteCarloConfig *cfg) {
+  cfg->theta1 = 1.8;
+  cfg->theta2 = 1.0;
+  cfg->spread = 0.05;
+  cfg->seconds = 10.0;
+  cfg->gamma = 0;
+  cfg->kT = 0;
+  cfg->batch = 4096;
+  cfg->max_samples = 1 << 22;
+  cfg->strata = 8;
+  cfg->neyman = 1;
+  cfg->z = 1.96;
+  cfg->target_flip = 0.005;
+  cfg->target_energy = 0.01;
+  cfg->seed = 1;
+  cfg->threads = 0;
+}
+
+typedef struct BatchJob {
+  const Ensemble *e;
+  long steps;
+  uint64_t seed;
+  int stochastic;
+  unsigned char *flipped;
+  double *energy;
+} BatchJob;
+
+static void batchTask(void *ctx, size_t begin, size_t end) {
+  BatchJob *job = ctx;
+  const Ensemble *e = job->e;
+
+  for (size_t i = begin; i < end; i++) {
+    job->flipped[i] = 0;
+  }
+
+  for (long s = 0; s < job->steps; s++) {
+    if (job->stochastic) {
+      ensembleLangevinRange(e, DT, job->seed, s, begin, end);
+    } else {
+      ensembleStepRange(e, DT, begin, end);
+    }
+    for (size_t i = begin; i < end; i++) {
+      job->flipped[i] |= fabs(e->t1[i]) > M_PI || fabs(e->t2[i]) > M_PI;
+    }
+  }
+
+  for (size_t i = begin; i < end; i++) {
+    Body a, b;
+    ensembleGet(e, i, &a, &b);
+    job->energy[i] = getKinetic(&a, &b) + getPotential(&a, &b);
+  }
+}
+
+static void welford(long n, double *mean, double *m2, double x) {
+  double d = x - *mean;
+  *mean += d / n;
+  *m2 += d * (x - *mean);
+}
+
+/* Flip variance from a smoothed proportion so a stratum that hasn't flipped
+ * yet isn't taken to be certain */
+static double flipVariance(const McStratum *s) {
+  double p = (s->flip_mean * s->n + 1) / (s->n + 2);
+  return p * (1 - p);
+}
+
+static double energyVariance(const McStratum *s) {
+  return s->n > 1 ? s->energy_m2 / (s->n - 1) : 0;
+}
+
+static void estimate(const MonteCarloConfig *cfg, const McStratum *strata,
+                     int count, McResult *r) {
+  double w = 1.0 / count;
+  double flip = 0, energy = 0, flip_var = 0, energy_var = 0;
+
+  r->samples = 0;
+  for (int h = 0; h < count; h++) {
+    const McStratum *s = &strata[h];
+    r->samples += s->n;
+    flip += w * s->flip_mean;
+    energy += w * s->energy_mean;
+    if (s->n > 0) {
+      flip_var += w * w * flipVariance(s) / s->n;
+      energy_var += w * w * energyVariance(s) / s->n;
+    }
+  }
+
+  r->flip = flip;
+  r->energy = energy;
+  r->flip_hw = cfg->z * sqrt(flip_var);
+  r->energy_hw = cfg->z * sqrt(energy_var);
+
+  /* Population variance = within-stratum + between-stratum parts */
+  double flip_pop = 0, energy_pop = 0;
+  for (int h = 0; h < count; h++) {
+    const McStratum *s = &strata[h];
+    flip_pop += w * (flipVariance(s) + pow(s->flip_mean - flip, 2));
+    energy_pop += w * (energyVariance(s) + pow(s->energy_mean - energy, 2));
+  }
+
+  double need = 0;
+  if (cfg->target_flip > 0) {
+    need = fmax(need, flip_pop * pow(cfg->z / cfg->target_flip, 2));
+  }
+  if (cfg->target_energy > 0) {
+    need = fmax(need, energy_pop * pow(cfg->z / cfg->target_energy, 2));
+  }
+  r->plain_samples = need;
+}
+
+static int converged(const MonteCarloConfig *cfg, const McStratum *strata,
+                     int count, const McResult *r) {
+  for (int h = 0; h < count; h++) {
+    if (strata[h].n < PILOT) {
+      return 0;
+    }
+  }
+  return (cfg->target_flip <= 0 || r->flip_hw <= cfg->target_flip) &&
+         (cfg->target_energy <= 0 || r->energy_hw <= cfg->target_energy);
+}
+
+/* Split a batch across strata. Neyman allocation gives each stratum samples
+ * in proportion to its standard deviation, relative to the target of each
+ * statistic, so cells deep inside a regular or chaotic region stop costing
+ * much once their variance is known. */
+static void allocate(const MonteCarloConfig *cfg, const McStratum *strata,
+                     int count, size_t batch, size_t *alloc) {
+  size_t floor = batch / count < MIN_PER_STRATUM ? batch / count
+                                                 : MIN_PER_STRATUM;
+  double *score = malloc(count * sizeof(double));
+  double total = 0;
+
+  for (int h = 0; h < count; h++) {
+    const McStratum *s = &strata[h];
+    if (!cfg->neyman || s->n < PILOT) {
+      score[h] = 1;
+    } else {
+      score[h] = 0;
+      if (cfg->target_flip > 0) {
+        score[h] = fmax(score[h], sqrt(flipVariance(s)) / cfg->target_flip);
+      }
+      if (cfg->target_energy > 0) {
+        score[h] =
+            fmax(score[h], sqrt(energyVariance(s)) / cfg->target_energy);
+      }
+    }
+    total += score[h];
+  }
+
+  size_t left = batch - floor * count;
+  size_t given = 0;
+  for (int h = 0; h < count; h++) {
+    alloc[h] = floor + (total > 0 ? (size_t)(left * score[h] / total) : 0);
+    given += alloc[h];
+  }
+
+  /* Rounding leftovers go to the highest scoring strata first */
+  while (given < batch) {
+    int best = 0;
+    for (int h = 1; h < count; h++) {
+      if (score[h] > score[best]) {
+        best = h;
+      }
+    }
+    alloc[best]++;
+    score[best] *= 0.5;
+    given++;
+  }
+
+  free(score);
+}
+
+int runMonteCarlo(const MonteCarloConfig *cfg, McResult *result) {
+  int count = cfg->strata * cfg->strata;
+  /* A lane of the ensemble and the per sample arrays below */
+  size_t per_sample = 4 * sizeof(double) + sizeof(int) + 1 + 3 * sizeof(double);
+  size_t batch = budgetFit(cfg->batch, per_sample, 0.5);
+  /* Every stratum still needs a sample per batch */
+  if (batch < (size_t)count) {
+    batch = count;
+  }
+  if (batch < cfg->batch) {
+    printf("Batch shrunk to %zu samples to fit the memory budget\n", batch);
+  }
+
+  Body a = {.l = 1.0, .m = 1.0};
+  Body b = {.l = 1.0, .m = 1.0};
+
+  Ensemble e = {0};
+  Pool *pool = poolCreate(cfg->threads);
+  McStratum *strata = calloc(count, sizeof(McStratum));
+  size_t *alloc = malloc(count * sizeof(size_t));
+  int *stratum_of = malloc(batch * sizeof(int));
+  unsigned char *flipped = malloc(batch);
+  double *energy = malloc(batch * sizeof(double));
+  double *u1 = malloc(batch * sizeof(double));
+  double *u2 = malloc(batch * sizeof(double));
+  int err = 1;
+
+  if (!pool || !strata || !alloc || !stratum_of || !flipped || !energy ||
+      !u1 || !u2 || ensembleInit(&e, batch, &a, &b) != 0) {
+    printf("Could not allocate a batch of %zu samples\n", batch);
+    goto done;
+  }
+  e.gamma = cfg->gamma;
+  e.kT = cfg->kT;
+
+  printf("%10s %10s %18s %22s\n", "batch", "samples", "P(flip)",
+         "E[energy]");
+
+  memset(result, 0, sizeof(*result));
+  for (uint64_t n_batch = 0; result->samples < cfg->max_samples; n_batch++) {
+    allocate(cfg, strata, count, batch, alloc);
+
+    /* Uniform points inside each stratum's cell, keyed by the global sample
+     * number so runs are reproducible */
+    philoxUniforms(cfg->seed, result->samples, 0xFFFFFFFFu, batch, u1, u2);
+    size_t lane = 0;
+    for (int h = 0; h < count; h++) {
+      int cx = h % cfg->strata, cy = h / cfg->strata;
+      for (size_t j = 0; j < alloc[h]; j++, lane++) {
+        double x = (cx + u1[lane]) / cfg->strata;
+        double y = (cy + u2[lane]) / cfg->strata;
+        e.t1[lane] = cfg->theta1 + cfg->spread * (2 * x - 1);
+        e.t2[lane] = cfg->theta2 + cfg->spread * (2 * y - 1);
+        e.w1[lane] = 0;
+        e.w2[lane] = 0;
+        stratum_of[lane] = h;
+      }
+    }
+
+    BatchJob job = {.e = &e,
+                    .steps = (long)(cfg->seconds / DT),
+                    .seed = cfg->seed + n_batch * 0x9E3779B97F4A7C15ULL,
+                    .stochastic = cfg->gamma > 0 || cfg->kT > 0,
+                    .flipped = flipped,
+                    .energy = energy};
+    poolRun(pool, batchTask, &job, batch, ENSEMBLE_BLOCK);
+
+    for (size_t i = 0; i < batch; i++) {
+      McStratum *s = &strata[stratum_of[i]];
+      s->n++;
+      welford(s->n, &s->flip_mean, &s->flip_m2, flipped[i]);
+      welford(s->n, &s->energy_mean, &s->energy_m2, energy[i]);
+    }
+
+    estimate(cfg, strata, count, result);
+    printf("%10lu %10zu %9.5f +- %.5f %12.5f +- %.5f\n",
+           (unsigned long)n_batch + 1, result->samples, result->flip,
+           result->flip_hw, result->energy, result->energy_hw);
+
+    if (converged(cfg, strata, count, result)) {
+      break;
+    }
+  }
+  err = 0;
+
+done:
+  ensembleFree(&e);
+  poolDestroy(pool);
+  free(strata);
+  free(alloc);
+  free(stratum_of);
+  free(flipped);
+  free(energy);
+  free(u1);
+  free(u2);
+  return err;
+}
+
+/* double-pendulum --montecarlo [--theta1 T1] [--theta2 T2] [--spread S]
+ *     [--seconds T] [--batch N] [--max-samples N] [--strata K]
+ *     [--target-flip W] [--target-energy W] [--z Z] [--proportional]
+ *     [--gamma GAMMA] [--kT KT] [--seed SEED] [--threads T] */
+int monteCarloMain(int argc, char **argv) {
+  MonteCarloConfig cfg;
+  monteCarloDefaults(&cfg);
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--theta1") && i + 1 < argc) {
+      cfg.theta1 = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--theta2") && i + 1 < argc) {
+      cfg.theta2 = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--spread") && i + 1 < argc) {
+      cfg.spread = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      cfg.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--batch") && i + 1 < argc) {
+      cfg.batch = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--max-samples") && i + 1 < argc) {
+      cfg.max_samples = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--strata") && i + 1 < argc) {
+      cfg.strata = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--target-flip") && i + 1 < argc) {
+      cfg.target_flip = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--target-energy") && i + 1 < argc) {
+      cfg.target_energy = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--z") && i + 1 < argc) {
+      cfg.z = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--proportional")) {
+      cfg.neyman = 0;
+    } else if (!strcmp(argv[i], "--gamma") && i + 1 < argc) {
+      cfg.gamma = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--kT") && i + 1 < argc) {
+      cfg.kT = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      cfg.seed = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      cfg.threads = atoi(argv[++i]);
+    }
+  }
+
+  if (cfg.strata <= 0 || cfg.batch < (size_t)cfg.strata * cfg.strata) {
+    printf("Batch must hold at least one sample per stratum\n");
+    return 1;
+  }
+
+  McResult r;
+  if (runMonteCarlo(&cfg, &r) != 0) {
+    return 1;
+  }
+
+  printf("\nP(flip before %.2f s) = %.5f +- %.5f\n", cfg.seconds, r.flip,
+         r.flip_hw);
+  printf("E[energy at %.2f s]   = %.5f +- %.5f\n", cfg.seconds, r.energy,
+         r.energy_hw);
+  printf("%zu samples, plain Monte Carlo would need about %.0f\n", r.samples,
+         r.plain_samples);
+  return 0;
+}
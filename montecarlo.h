@@ -0,0 +1,45 @@
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Uncertainty propagation: initial angles are drawn uniformly from a box
+ * around (theta1, theta2), split into strata x strata cells, and integrated
+ * for a fixed time. Samples run in batches until the confidence interval of
+ * every requested statistic is narrower than its target. */
+typedef struct MonteCarloConfig {
+  double theta1, theta2;
+  double spread;  // Half-width of the box on each angle (rad)
+  double seconds; // Integration time T
+  double gamma, kT;
+  size_t batch;
+  size_t max_samples;
+  int strata;     // Cells per axis
+  int neyman;     // Allocate batches by stratum variance, else evenly
+  double z;       // Critical value of the interval, 1.96 for 95%
+  double target_flip;   // Half-width goal for P(flip before T), 0 to ignore
+  double target_energy; // Half-width goal for E[energy at T], 0 to ignore
+  uint64_t seed;
+  int threads;
+} MonteCarloConfig;
+
+typedef struct McStratum {
+  long n;
+  double flip_mean, flip_m2;
+  double energy_mean, energy_m2;
+} McStratum;
+
+typedef struct McResult {
+  size_t samples;
+  double flip, flip_hw;
+  double energy, energy_hw;
+  double plain_samples; // Simple random sampling needed for the same widths
+} McResult;
+
+void monteCarloDefaults(MonteCarloConfig *cfg);
+int runMonteCarlo(const MonteCarloConfig *cfg, McResult *result);
+
+int monteCarloMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include "mppi.h"
+#include "clock.h"
+#include "metrics.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int mppiInit(Mppi *m, size_t k, int horizon, double dt, const MppiCost *cost,
+             Pool *pool, const Body *a, const Body *b) {
+  memset(m, 0, sizeof(*m));
+  m->k = k;
+  m->horizon = horizon;
+  m->dt = dt;
+  m->cost = *cost;
+  m->pool = pool;
+  return ensembleInit(&m->ens, k, a, b);
+}
+
+void mppiFree(Mppi *m) { ensembleFree(&m->ens); }
+
+static void rolloutTask(void *ctx, size_t begin, size_t end) {
+  Mppi *m = ctx;
+  const MppiCost *c = &m->cost;
+  Ensemble e = m->ens;
+  double *costs = m->costs;
+
+  for (size_t i = begin; i < end; i++) {
+    e.t1[i] = m->a.t;
+    e.t2[i] = m->b.t;
+    e.w1[i] = m->a.w;
+    e.w2[i] = m->b.w;
+    costs[i] = 0;
+  }
+
+  /* Each chunk runs its lanes over the whole horizon, so the pool is woken
+   * once per tick rather than once per step */
+  for (int h = 0; h < m->horizon; h++) {
+    e.u1 = m->torques + 2 * h * m->k;
+    e.u2 = e.u1 + m->k;
+    ensembleStepRange(&e, m->dt, begin, end);
+
+    double scale = h == m->horizon - 1 ? 1 + c->w_terminal : 1;
+    for (size_t i = begin; i < end; i++) {
+      double state =
+          c->w_angle * (2 - cos(e.t1[i] - c->target_t1) -
+                        cos(e.t2[i] - c->target_t2)) +
+          c->w_velocity * (e.w1[i] * e.w1[i] + e.w2[i] * e.w2[i]);
+      costs[i] += scale * state +
+                  c->w_torque * (e.u1[i] * e.u1[i] + e.u2[i] * e.u2[i]);
+    }
+  }
+}
+
+void mppiRollouts(Mppi *m, const Body *a, const Body *b, const double *torques,
+                  double *costs) {
+  m->a = *a;
+  m->b = *b;
+  m->torques = torques;
+  m->costs = costs;
+
+  /* About four chunks per thread, whole blocks each */
+  int threads = m->pool ? m->pool->n_threads + 1 : 1;
+  size_t grain = m->k / (4 * threads);
+  grain = (grain + ENSEMBLE_BLOCK - 1) / ENSEMBLE_BLOCK * ENSEMBLE_BLOCK;
+
+  poolRun(m->pool, rolloutTask, m, m->k, grain);
+}
+
+void mppiWeights(const double *costs, size_t k, double lambda,
+                 double *weights) {
+  double best = costs[0];
+  for (size_t i = 1; i < k; i++) {
+    if (costs[i] < best) {
+      best = costs[i];
+    }
+  }
+
+  double sum = 0;
+  for (size_t i = 0; i < k; i++) {
+    weights[i] = exp(-(costs[i] - best) / lambda);
+    sum += weights[i];
+  }
+  for (size_t i = 0; i < k; i++) {
+    weights[i] /= sum;
+  }
+}
+
+static double gaussian(unsigned *seed) {
+  double u1 = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+  double u2 = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static int compareDouble(const void *x, const void *y) {
+  double a = *(const double *)x, b = *(const double *)y;
+  return (a > b) - (a < b);
+}
+
+/* double-pendulum --mppi [--rollouts K] [--horizon H] [--ticks N]
+ *                        [--threads T] [--sigma NM] [--lambda L]
+ *
+ * Closed-loop MPPI holding the pendulum inverted, reporting how long the
+ * rollouts take each tick. */
+int mppiMain(int argc, char **argv) {
+  size_t k = 1024;
+  int horizon = 50;
+  int ticks = 500;
+  int threads = 0;
+  double sigma = 5.0;
+  double lambda = 1.0;
+  double dt = DT;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--rollouts") && i + 1 < argc) {
+      k = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--horizon") && i + 1 < argc) {
+      horizon = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--ticks") && i + 1 < argc) {
+      ticks = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--sigma") && i + 1 < argc) {
+      sigma = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--lambda") && i + 1 < argc) {
+      lambda = atof(argv[++i]);
+    }
+  }
+
+  if (k == 0 || horizon <= 0 || ticks <= 0) {
+    printf("Rollouts, horizon and ticks must be positive\n");
+    return 1;
+  }
+
+  Body a = {.l = 1.0, .m = 1.0, .t = M_PI - 0.1, .w = 0.0};
+  Body b = {.l = 1.0, .m = 1.0, .t = M_PI + 0.1, .w = 0.0};
+  MppiCost cost = {.target_t1 = M_PI,
+                   .target_t2 = M_PI,
+                   .w_angle = 10.0,
+                   .w_velocity = 0.1,
+                   .w_torque = 1e-4,
+                   .w_terminal = 10.0};
+
+  Pool *pool = poolCreate(threads);
+  Mppi m = {0};
+  size_t steps = (size_t)horizon * 2 * k;
+  double *nominal = calloc(horizon * 2, sizeof(double));
+  double *torques = malloc(steps * sizeof(double));
+  double *costs = malloc(k * sizeof(double));
+  double *weights = malloc(k * sizeof(double));
+  double *latency = malloc(ticks * sizeof(double));
+  int err = 1;
+
+  if (pool == NULL || !nominal || !torques || !costs || !weights ||
+      !latency || mppiInit(&m, k, horizon, dt, &cost, pool, &a, &b) != 0) {
+    printf("Could not allocate %zu rollouts\n", k);
+    goto done;
+  }
+
+  unsigned seed = 1;
+  for (int tick = 0; tick < ticks; tick++) {
+    for (int h = 0; h < horizon; h++) {
+      double *u1 = torques + 2 * h * k, *u2 = u1 + k;
+      for (size_t i = 0; i < k; i++) {
+        u1[i] = nominal[2 * h] + sigma * gaussian(&seed);
+        u2[i] = nominal[2 * h + 1] + sigma * gaussian(&seed);
+      }
+    }
+
+    double start = nowSeconds();
+    mppiRollouts(&m, &a, &b, torques, costs);
+    latency[tick] = nowSeconds() - start;
+
+    mppiWeights(costs, k, lambda, weights);
+    for (int h = 0; h < horizon; h++) {
+      double *u1 = torques + 2 * h * k, *u2 = u1 + k;
+      double s1 = 0, s2 = 0;
+      for (size_t i = 0; i < k; i++) {
+        s1 += weights[i] * u1[i];
+        s2 += weights[i] * u2[i];
+      }
+      nominal[2 * h] = s1;
+      nominal[2 * h + 1] = s2;
+    }
+
+    a.torque = nominal[0];
+    b.torque = nominal[1];
+    stepPositions(&a, &b, dt);
+    metricsAdd(COUNTER_STEPS, 1);
+    metricsAdd(COUNTER_LAGRANGE, 4);
+
+    /* Shift the plan forward one step */
+    memmove(nominal, nominal + 2, (horizon - 1) * 2 * sizeof(double));
+    nominal[2 * horizon - 2] = nominal[2 * horizon - 1] = 0;
+  }
+
+  qsort(latency, ticks, sizeof(double), compareDouble);
+  printf("%zu rollouts x %d steps on %d threads\n", k, horizon,
+         pool->n_threads + 1);
+  printf("rollout latency: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+         latency[ticks / 2] * 1e3, latency[ticks * 99 / 100] * 1e3,
+         latency[ticks - 1] * 1e3);
+  printf("%.2f M pendulum steps/s\n",
+         (double)k * horizon / latency[ticks / 2] * 1e-6);
+  printf("final state: t1 = %.4Lf, t2 = %.4Lf, w1 = %.4Lf, w2 = %.4Lf\n", a.t,
+         b.t, a.w, b.w);
+  err = 0;
+
+done:
+  mppiFree(&m);
+  poolDestroy(pool);
+  free(nominal);
+  free(torques);
+  free(costs);
+  free(weights);
+  free(latency);
+  return err;
+}
@@ -0,0 +1,55 @@
+#ifndef MPPI_H
+#define MPPI_H
+
+#include "ensemble.h"
+#include "pendulum.h"
+#include "pool.h"
+
+/* Running cost of a rollout, summed over the horizon:
+ *   w_angle * (2 - cos(t1 - target_t1) - cos(t2 - target_t2))
+ * + w_velocity * (w1^2 + w2^2) + w_torque * (u1^2 + u2^2)
+ * with the state part counted w_terminal more times at the last step. */
+typedef struct MppiCost {
+  double target_t1, target_t2;
+  double w_angle;
+  double w_velocity;
+  double w_torque;
+  double w_terminal;
+} MppiCost;
+
+/* Everything a control tick needs, allocated once up front */
+typedef struct Mppi {
+  size_t k;
+  int horizon;
+  double dt;
+  MppiCost cost;
+  Pool *pool;
+  Ensemble ens;
+
+  /* Set per tick */
+  Body a, b;
+  const double *torques;
+  double *costs;
+} Mppi;
+
+int mppiInit(Mppi *m, size_t k, int horizon, double dt, const MppiCost *cost,
+             Pool *pool, const Body *a, const Body *b);
+void mppiFree(Mppi *m);
+
+/* Roll k copies of (a, b) forward over the horizon, lane i following its own
+ * torque sequence, and write the cost of each rollout to costs[i].
+ *
+ * torques holds horizon steps of 2 * k values each: u1 for every lane
+ * followed by u2 for every lane, so step h of lane i is
+ *   u1 = torques[2 * h * k + i], u2 = torques[(2 * h + 1) * k + i].
+ * The buffer is read in place and nothing is allocated. */
+void mppiRollouts(Mppi *m, const Body *a, const Body *b, const double *torques,
+                  double *costs);
+
+/* Softmax of -costs / lambda, normalised to sum to one */
+void mppiWeights(const double *costs, size_t k, double lambda,
+                 double *weights);
+
+int mppiMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,93 @@
+#include "pendulum.h"
+
+#include <math.h>
+
+const Gravity gravities[N_GRAVITIES] = {
+    {"Sun", 274.0},
+    {"Mercury", 3.70},
+    {"Venus", 8.87},
+    {"Earth", 9.78},
+    {"Mars", 3.73},
+    {"Jupiter", 23.12},
+    {"Saturn", 8.96},
+    {"Uranus", 8.69},
+    {"Neptune", 11.00},
+    {"Pluto", 0.62},
+    {"Moon", 1.625}};
+
+long double getPotential(Body *a, Body *b) {
+  long double y1 = -a->l * cosl(a->t);
+  long double y2 = y1 - b->l * cosl(b->t);
+
+  return a->m * G * y1 + b->m * G * y2;
+}
+
+long double getKinetic(Body *a, Body *b) {
+  long double av2 = pow(a->l * a->w, 2);
+  long double bv2 = pow(b->l * b->w, 2);
+
+  long double k1 = 0.5 * a->m * av2;
+  long double k2 =
+      0.5 * b->m *
+      (av2 + bv2 + 2 * a->l * b->l * a->w * b->w * cosl(a->t - b->t));
+
+  return k1 + k2;
+}
+
+void lagrange(Body *a, Body *b, long double *k, long double *y) {
+
+  long double b_a = (b->l / a->l);
+  long double a_b = (a->l / b->l);
+  long double total_mass = (a->m + b->m);
+
+  long double accel_1 = b_a * (b->m / total_mass) * cosl(y[0] - y[1]);
+  long double accel_2 = a_b * cosl(y[0] - y[1]);
+
+  long double force_1 =
+      -b_a * (b->m / total_mass) * (y[3] * y[3]) * sinl(y[0] - y[1]) -
+      (G / a->l) * sinl(y[0]) + a->torque / (total_mass * a->l * a->l);
+  long double force_2 =
+      a_b * (y[2] * y[2]) * sinl(y[0] - y[1]) - (G / b->l) * sinl(y[1]) +
+      b->torque / (b->m * b->l * b->l);
+
+  long double g1 = (force_1 - accel_1 * force_2) / (1 - accel_1 * accel_2);
+  long double g2 = (force_2 - accel_2 * force_1) / (1 - accel_1 * accel_2);
+
+  k[0] = y[2];
+  k[1] = y[3];
+  k[2] = g1;
+  k[3] = g2;
+}
+
+void stepPositions(Body *a, Body *b, long double dt) {
+  long double y[4] = {a->t, b->t, a->w, b->w};
+  long double k1[4], k2[4], k3[4], k4[4];
+  long double tmp[4];
+
+  lagrange(a, b, k1, y);
+
+  tmp[0] = y[0] + dt * k1[0] / 2;
+  tmp[1] = y[1] + dt * k1[1] / 2;
+  tmp[2] = y[2] + dt * k1[2] / 2;
+  tmp[3] = y[3] + dt * k1[3] / 2;
+  lagrange(a, b, k2, tmp);
+
+  tmp[0] = y[0] + dt * k2[0] / 2;
+  tmp[1] = y[1] + dt * k2[1] / 2;
+  tmp[2] = y[2] + dt * k2[2] / 2;
+  tmp[3] = y[3] + dt * k2[3] / 2;
+  lagrange(a, b, k3, tmp);
+
+  tmp[0] = y[0] + dt * k3[0];
+  tmp[1] = y[1] + dt * k3[1];
+  tmp[2] = y[2] + dt * k3[2];
+  tmp[3] = y[3] + dt * k3[3];
+  lagrange(a, b, k4, tmp);
+
+  a->t += 1.0 / 6.0 * dt * (k1[0] + 2.0 * k2[0] + 2.0 * k3[0] + k4[0]);
+  b->t += 1.0 / 6.0 * dt * (k1[1] + 2.0 * k2[1] + 2.0 * k3[1] + k4[1]);
+  a->w += 1.0 / 6.0 * dt * (k1[2] + 2.0 * k2[2] + 2.0 * k3[2] + k4[2]);
+  b->w += 1.0 / 6.0 * dt * (k1[3] + 2.0 * k2[3] + 2.0 * k3[3] + k4[3]);
+}
+
+void updatePositions(Body *a, Body *b) { stepPositions(a, b, DT); }
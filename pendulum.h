@@ -0,0 +1,58 @@
+#ifndef PENDULUM_H
+#define PENDULUM_H
+
+/* Acceleration due to gravity (m/s^2)
+ * https://nssdc.gsfc.nasa.gov/planetary/
+ * Uncomment one of these
+ * */
+// #define G 274.0    // Sun gravity
+// #define G 3.70     // Mercury gravity
+// #define G 8.87     // Venus gravity
+#define G 9.78     // Earth
+// #define G 3.73     // Mars 
+// #define G 23.12    // Jupiter
+// #define G 8.96     // Saturn
+// #define G 8.69     // Uranus
+// #define G 11.00    // Neptune
+// #define G 0.62     // Pluto
+
+// #define G 1.625    // Moon 
+
+
+#define DT 0.01   // Time diff
+
+/* The same gravities by name, for comparing them side by side */
+typedef struct Gravity {
+  const char *name;
+  double g;
+} Gravity;
+
+#define N_GRAVITIES 11
+extern const Gravity gravities[N_GRAVITIES];
+
+typedef struct Color {
+  int r;
+  int g;
+  int b;
+  int a;
+} Color;
+
+typedef struct Body {
+  long double l;
+  long double m;
+  long double t;
+  long double w;
+  long double torque; // Generalized torque on this segment's angle (N m)
+  Color color;
+} Body;
+
+long double getPotential(Body *a, Body *b);
+long double getKinetic(Body *a, Body *b);
+
+void lagrange(Body *a, Body *b, long double *k, long double *y);
+
+/* Advance both bodies by one RK4 step of length dt */
+void stepPositions(Body *a, Body *b, long double dt);
+void updatePositions(Body *a, Body *b);
+
+#endif
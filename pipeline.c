@@ -0,0 +1,177 @@
+#include "pipeline.h"
+#include "clock.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SPIN 2000 // Polls before yielding the cpu
+#define NAP_MIN 50000 // Nanoseconds between polls once a wait drags on,
+#define NAP_MAX 2000000 // doubling up to this
+
+static int queueInit(Queue *q, size_t n) {
+  size_t cap = 1;
+  while (cap < n) {
+    cap *= 2;
+  }
+  memset(q, 0, sizeof(Queue));
+  q->slots = malloc(cap * sizeof(void *));
+  q->mask = cap - 1;
+  return q->slots == NULL;
+}
+
+/* Never full: every queue has room for all the items */
+static void queuePush(Queue *q, void *item) {
+  size_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+  q->slots[tail & q->mask] = item;
+  __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void *queuePop(Queue *q) {
+  size_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  if (head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  void *item = q->slots[head & q->mask];
+  __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+  return item;
+}
+
+/* Spin briefly, then yield, then nap for longer and longer until an item
+ * arrives. NULL if the pipeline was aborted meanwhile. */
+static PipeItem *take(Pipeline *p, Queue *q) {
+  long nap = NAP_MIN;
+  for (long i = 0;; i++) {
+    PipeItem *item = queuePop(q);
+    if (item) {
+      return item;
+    }
+    if (__atomic_load_n(&p->abort, __ATOMIC_RELAXED)) {
+      return NULL;
+    }
+    if (i > 2 * SPIN) {
+      struct timespec ts = {0, nap};
+      nanosleep(&ts, NULL);
+      nap = nap < NAP_MAX / 2 ? 2 * nap : NAP_MAX;
+    } else if (i > SPIN) {
+      sched_yield();
+    }
+  }
+}
+
+static void *stageThread(void *arg) {
+  Stage *s = arg;
+  Pipeline *p = s->p;
+  Queue *in = &p->queues[s->index];
+  Queue *out = &p->queues[(s->index + 1) % p->n_stages];
+  long seq = 0;
+
+  for (;;) {
+    double t0 = nowSeconds();
+    PipeItem *item = take(p, in);
+    double t1 = nowSeconds();
+    s->stats.waiting += t1 - t0;
+    if (item == NULL) {
+      return NULL;
+    }
+
+    if (s->index == 0) {
+      item->seq = seq++;
+      item->last = 0;
+    }
+    item->bytes = 0;
+    int err = s->fn(s->ctx, item);
+    s->stats.busy += nowSeconds() - t1;
+    /* Atomic, as the metrics exporter reads it while the stage runs */
+    __atomic_store_n(&s->stats.items, s->stats.items + 1, __ATOMIC_RELAXED);
+    s->stats.bytes += item->bytes;
+    if (err) {
+      __atomic_store_n(&p->abort, 1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+
+    int last = item->last;
+    queuePush(out, item);
+    if (last) {
+      return NULL;
+    }
+  }
+}
+
+void pipelineInit(Pipeline *p) { memset(p, 0, sizeof(Pipeline)); }
+
+int pipelineStage(Pipeline *p, const char *name, StageFn fn, void *ctx) {
+  if (p->n_stages == PIPELINE_STAGES) {
+    return 1;
+  }
+  Stage *s = &p->stages[p->n_stages];
+  s->name = name;
+  s->fn = fn;
+  s->ctx = ctx;
+  s->p = p;
+  s->index = p->n_stages++;
+  return 0;
+}
+
+int pipelineRun(Pipeline *p, void **buffers, int n) {
+  int err = 0;
+  p->abort = 0;
+  p->n_items = n;
+  p->items = calloc(n, sizeof(PipeItem));
+  for (int k = 0; k < p->n_stages; k++) {
+    err |= queueInit(&p->queues[k], n);
+  }
+  if (p->items == NULL || err || p->n_stages == 0) {
+    err = 1;
+    goto done;
+  }
+
+  /* The source's queue doubles as the free list */
+  for (int i = 0; i < n; i++) {
+    p->items[i].data = buffers[i];
+    p->items[i].slot = i;
+    queuePush(&p->queues[0], &p->items[i]);
+  }
+
+  for (int k = 0; k < p->n_stages; k++) {
+    memset(&p->stages[k].stats, 0, sizeof(StageStats));
+  }
+  __atomic_store_n(&p->running, 1, __ATOMIC_RELEASE);
+  double start = nowSeconds();
+  int started = 0;
+  for (; started < p->n_stages; started++) {
+    Stage *s = &p->stages[started];
+    if (pthread_create(&s->thread, NULL, stageThread, s) != 0) {
+      p->abort = 1;
+      break;
+    }
+  }
+  for (int k = 0; k < started; k++) {
+    pthread_join(p->stages[k].thread, NULL);
+  }
+  p->elapsed = nowSeconds() - start;
+  __atomic_store_n(&p->running, 0, __ATOMIC_RELEASE);
+  err = p->abort;
+
+done:
+  for (int k = 0; k < p->n_stages; k++) {
+    free(p->queues[k].slots);
+    p->queues[k].slots = NULL;
+  }
+  free(p->items);
+  p->items = NULL;
+  return err;
+}
+
+void pipelineReport(const Pipeline *p, FILE *f) {
+  fprintf(f, "%-10s %10s %10s %10s %7s %7s\n", "stage", "items", "items/s",
+          "MB/s", "busy", "waiting");
+  for (int k = 0; k < p->n_stages; k++) {
+    const Stage *s = &p->stages[k];
+    double t = p->elapsed > 0 ? p->elapsed : 1;
+    fprintf(f, "%-10s %10ld %10.1f %10.1f %6.1f%% %6.1f%%\n", s->name,
+            s->stats.items, s->stats.items / t, s->stats.bytes / t / 1e6,
+            100 * s->stats.busy / t, 100 * s->stats.waiting / t);
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define PIPELINE_STAGES 8 // Most stages in one pipeline
+
+/* Bounded single-producer single-consumer ring of items. Head and tail
+ * live on separate cache lines, so the two threads only ever share the
+ * slots they hand over. */
+typedef struct Queue {
+  void **slots;
+  size_t mask; // Capacity - 1, a power of two
+  char pad0[64];
+  size_t head; // Next slot to take, written by the consumer only
+  char pad1[64];
+  size_t tail; // Next slot to fill, written by the producer only
+  char pad2[64];
+} Queue;
+
+/* One of the caller's buffers on its way through the stages */
+typedef struct PipeItem {
+  void *data;
+  int slot;     // Index of data among the buffers given to pipelineRun()
+  long seq;     // Position in the stream, set by the source
+  size_t bytes; // Size of what the stage produced, for its throughput
+  int last;     // Set by the source on its final item
+} PipeItem;
+
+/* Works on one item in place. The first stage is the source and fills
+ * free items. Non-zero stops the whole pipeline. */
+typedef int (*StageFn)(void *ctx, PipeItem *item);
+
+typedef struct StageStats {
+  long items; // Stored atomically, for the metrics exporter
+  size_t bytes;
+  double busy;    // Seconds inside the stage function
+  double waiting; // Seconds waiting for an item
+} StageStats;
+
+typedef struct Stage {
+  const char *name;
+  StageFn fn;
+  void *ctx;
+  struct Pipeline *p;
+  int index;
+  pthread_t thread;
+  StageStats stats; // Written by the stage's thread only
+} Stage;
+
+/* A chain of stages, each on its own thread, passing items down queues.
+ * Items come back from the last stage to the source through a free queue,
+ * so only as many as the caller provides are ever in flight. A slow stage
+ * fills up the queue in front of it and the source, finding no free item,
+ * waits instead of allocating: that's the backpressure. */
+typedef struct Pipeline {
+  Stage stages[PIPELINE_STAGES];
+  /* queues[k] feeds stages[k], and the last stage feeds queues[0] */
+  Queue queues[PIPELINE_STAGES];
+  int n_stages;
+  PipeItem *items;
+  int n_items;
+  int abort;
+  int running; // Queues are live, for readers on other threads
+  double elapsed; // Seconds the last run took
+} Pipeline;
+
+void pipelineInit(Pipeline *p);
+
+/* Append a stage, returns 1 if there are already PIPELINE_STAGES */
+int pipelineStage(Pipeline *p, const char *name, StageFn fn, void *ctx);
+
+/* Run until the source's last item has been through every stage, cycling
+ * the n buffers. Returns non-zero if a stage failed. */
+int pipelineRun(Pipeline *p, void **buffers, int n);
+
+/* Items, throughput and time busy or waiting per stage */
+void pipelineReport(const Pipeline *p, FILE *f);
+
+#endif
@@ -0,0 +1,128 @@
+#include "pool.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SPIN 20000
+
+static void runChunks(Pool *p) {
+  size_t begin;
+  while ((begin = __atomic_fetch_add(&p->next, p->grain, __ATOMIC_RELAXED)) <
+         p->n) {
+    size_t end = begin + p->grain < p->n ? begin + p->grain : p->n;
+    p->task(p->ctx, begin, end);
+  }
+}
+
+static void *worker(void *arg) {
+  Pool *p = arg;
+  unsigned seen = 0;
+
+  for (;;) {
+    unsigned gen;
+    for (int i = 0; i < SPIN; i++) {
+      gen = __atomic_load_n(&p->generation, __ATOMIC_ACQUIRE);
+      if (gen != seen)
+        break;
+    }
+
+    if (gen == seen) {
+      pthread_mutex_lock(&p->lock);
+      while ((gen = __atomic_load_n(&p->generation, __ATOMIC_ACQUIRE)) ==
+                 seen &&
+             !p->quit) {
+        pthread_cond_wait(&p->wake, &p->lock);
+      }
+      pthread_mutex_unlock(&p->lock);
+    }
+
+    if (__atomic_load_n(&p->quit, __ATOMIC_ACQUIRE)) {
+      return NULL;
+    }
+
+    seen = gen;
+    runChunks(p);
+    __atomic_fetch_sub(&p->busy, 1, __ATOMIC_RELEASE);
+  }
+}
+
+Pool *poolCreate(int n_threads) {
+  if (n_threads <= 0) {
+    n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  Pool *p = calloc(1, sizeof(Pool));
+  if (p == NULL) {
+    return NULL;
+  }
+
+  p->n_threads = n_threads > 1 ? n_threads - 1 : 0;
+  p->threads = calloc(p->n_threads + 1, sizeof(pthread_t));
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->wake, NULL);
+
+  for (int i = 0; i < p->n_threads; i++) {
+    if (pthread_create(&p->threads[i], NULL, worker, p) != 0) {
+      p->n_threads = i;
+      break;
+    }
+  }
+
+  return p;
+}
+
+void poolDestroy(Pool *p) {
+  if (p == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  __atomic_store_n(&p->quit, 1, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&p->generation, 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i = 0; i < p->n_threads; i++) {
+    pthread_join(p->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&p->wake);
+  pthread_mutex_destroy(&p->lock);
+  free(p->threads);
+  free(p);
+}
+
+void poolRun(Pool *p, PoolTask task, void *ctx, size_t n, size_t grain) {
+  if (grain == 0) {
+    grain = 1;
+  }
+
+  /* Not worth waking anyone for a single chunk */
+  if (p == NULL || p->n_threads == 0 || n <= grain) {
+    if (n > 0) {
+      task(ctx, 0, n);
+    }
+    return;
+  }
+
+  p->task = task;
+  p->ctx = ctx;
+  p->n = n;
+  p->grain = grain;
+  p->next = 0;
+  p->busy = p->n_threads;
+
+  pthread_mutex_lock(&p->lock);
+  __atomic_fetch_add(&p->generation, 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+
+  runChunks(p);
+
+  for (int i = 0; __atomic_load_n(&p->busy, __ATOMIC_ACQUIRE) > 0; i++) {
+    if (i > SPIN) {
+      sched_yield();
+    }
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* Processes items [begin, end) of a parallel job */
+typedef void (*PoolTask)(void *ctx, size_t begin, size_t end);
+
+/* Persistent worker threads. The calling thread takes part in every job, and
+ * idle workers spin briefly before blocking so back-to-back jobs (one per
+ * control tick, one per frame) don't pay for a futex wake-up each time. */
+typedef struct Pool {
+  int n_threads; // Workers, not counting the caller
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+
+  PoolTask task;
+  void *ctx;
+  size_t n;
+  size_t grain;
+
+  size_t next;         // Next unclaimed item
+  int busy;            // Workers still inside the current job
+  unsigned generation; // Bumped once per job
+  int quit;
+} Pool;
+
+/* n_threads counts the caller, 0 means one per online cpu */
+Pool *poolCreate(int n_threads);
+void poolDestroy(Pool *p);
+
+/* Split [0, n) into chunks of at least grain items and run them on the pool.
+ * Returns once every chunk is done. */
+void poolRun(Pool *p, PoolTask task, void *ctx, size_t n, size_t grain);
+
+#endif
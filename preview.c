@@ -0,0 +1,144 @@
+#include "preview.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Integrate the latest request into the writing buffer. Returns 0 if a
+ * newer request arrived before it finished. */
+static int compute(Preview *p, unsigned gen, double t1, double t2, double g) {
+  Ensemble *e = &p->e;
+  SDL_FPoint *path = p->buffers[p->writing];
+
+  /* Copies on a circle around the start in (theta1, theta2) */
+  e->g = g;
+  for (int k = 0; k < PREVIEW_LANES; k++) {
+    double a = 2 * M_PI * k / (PREVIEW_LANES - 1);
+    double r = k ? PREVIEW_NUDGE : 0;
+    e->t1[k] = t1 + r * cos(a);
+    e->t2[k] = t2 + r * sin(a);
+    e->w1[k] = 0;
+    e->w2[k] = 0;
+  }
+
+  for (int s = 0; s < PREVIEW_STEPS; s++) {
+    if (__atomic_load_n(&p->requested, __ATOMIC_RELAXED) != gen) {
+      return 0;
+    }
+    ensembleStepRange(e, DT, 0, PREVIEW_LANES);
+    for (int k = 0; k < PREVIEW_LANES; k++) {
+      SDL_FPoint *q = &path[k * PREVIEW_STEPS + s];
+      q->x = e->l1 * sin(e->t1[k]) + e->l2 * sin(e->t2[k]);
+      q->y = e->l1 * cos(e->t1[k]) + e->l2 * cos(e->t2[k]);
+    }
+  }
+  return 1;
+}
+
+static void *worker(void *arg) {
+  Preview *p = arg;
+  unsigned done = 0;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (p->requested == done && !p->quit) {
+      pthread_cond_wait(&p->wake, &p->lock);
+    }
+    if (p->quit) {
+      break;
+    }
+    unsigned gen = p->requested;
+    double t1 = p->t1, t2 = p->t2, g = p->g;
+    pthread_mutex_unlock(&p->lock);
+
+    int finished = compute(p, gen, t1, t2, g);
+
+    pthread_mutex_lock(&p->lock);
+    if (finished) {
+      int w = p->writing;
+      p->writing = p->ready;
+      p->ready = w;
+      p->fresh = gen;
+      done = gen;
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+static void freeBuffers(Preview *p) {
+  for (int i = 0; i < 3; i++) {
+    free(p->buffers[i]);
+    p->buffers[i] = NULL;
+  }
+}
+
+int previewInit(Preview *p, const Ensemble *like) {
+  Body a = {.l = like->l1, .m = like->m1};
+  Body b = {.l = like->l2, .m = like->m2};
+  memset(p, 0, sizeof(Preview));
+  if (ensembleInit(&p->e, PREVIEW_LANES, &a, &b)) {
+    return 1;
+  }
+  for (int i = 0; i < 3; i++) {
+    p->buffers[i] =
+        malloc((size_t)PREVIEW_LANES * PREVIEW_STEPS * sizeof(SDL_FPoint));
+  }
+  if (!p->buffers[0] || !p->buffers[1] || !p->buffers[2]) {
+    freeBuffers(p);
+    ensembleFree(&p->e);
+    return 1;
+  }
+  p->writing = 0;
+  p->ready = 1;
+  p->reading = 2;
+
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->wake, NULL);
+  if (pthread_create(&p->thread, NULL, worker, p) != 0) {
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    freeBuffers(p);
+    ensembleFree(&p->e);
+    return 1;
+  }
+  return 0;
+}
+
+void previewFree(Preview *p) {
+  pthread_mutex_lock(&p->lock);
+  p->quit = 1;
+  pthread_cond_signal(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+  pthread_join(p->thread, NULL);
+
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->wake);
+  freeBuffers(p);
+  ensembleFree(&p->e);
+}
+
+void previewRequest(Preview *p, double t1, double t2, double g) {
+  pthread_mutex_lock(&p->lock);
+  p->t1 = t1;
+  p->t2 = t2;
+  p->g = g;
+  /* Skip 0, which stands for nothing done yet */
+  unsigned gen = p->requested + 1 ? p->requested + 1 : 1;
+  __atomic_store_n(&p->requested, gen, __ATOMIC_RELAXED);
+  pthread_cond_signal(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+}
+
+const SDL_FPoint *previewPaths(Preview *p) {
+  pthread_mutex_lock(&p->lock);
+  if (p->fresh) {
+    int r = p->reading;
+    p->reading = p->ready;
+    p->ready = r;
+    p->shown = p->fresh;
+    p->fresh = 0;
+  }
+  pthread_mutex_unlock(&p->lock);
+  return p->shown ? p->buffers[p->reading] : NULL;
+}
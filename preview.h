@@ -0,0 +1,48 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <SDL2/SDL.h>
+#include <pthread.h>
+
+#include "ensemble.h"
+
+#define PREVIEW_LANES 32   // The dragged start and nudged copies of it
+#define PREVIEW_STEPS 1000 // 10 s ahead at DT
+#define PREVIEW_NUDGE 1e-3 // Radius of the copies around the start (rad)
+
+/* Where a start would go over the next PREVIEW_STEPS steps, worked out on a
+ * thread of its own while a bob is dragged. A new request bumps the
+ * generation, which makes the worker drop the one it's on. Finished paths
+ * are triple buffered so neither side ever waits on the other. */
+typedef struct Preview {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  Ensemble e; // The worker's lanes
+
+  /* Latest request, under lock */
+  double t1, t2, g;
+  unsigned requested; // Generation, also read without the lock to cancel
+  int quit;
+
+  /* PREVIEW_LANES tip paths of PREVIEW_STEPS points each, in world
+   * coordinates. The worker owns writing, the viewer reading, and ready
+   * holds the newest result until the viewer takes it. */
+  SDL_FPoint *buffers[3];
+  int writing, ready, reading;
+  unsigned fresh; // Generation in ready if the viewer hasn't taken it
+  unsigned shown; // Generation in reading, 0 for none
+} Preview;
+
+/* like gives the arm lengths and masses */
+int previewInit(Preview *p, const Ensemble *like);
+void previewFree(Preview *p);
+
+/* Ask for the paths from rest at (t1, t2) under gravity g */
+void previewRequest(Preview *p, double t1, double t2, double g);
+
+/* Newest finished paths, lane after lane with the exact start first. NULL
+ * until one is done. */
+const SDL_FPoint *previewPaths(Preview *p);
+
+#endif
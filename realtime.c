@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include "realtime.h"
+#include "metrics.h"
+
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define NSEC 1000000000L
+
+static long long nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+static long double wrapAngle(long double x) {
+  return x - 2 * M_PI * floorl((x + M_PI) / (2 * M_PI));
+}
+
+void uprightController(Body *a, Body *b, long double time, void *ctx) {
+  UprightGains *gains = ctx;
+  (void)time;
+
+  /* Desired accelerations: a critically damped PD about theta = pi */
+  long double e1 = wrapAngle(a->t - M_PI);
+  long double e2 = wrapAngle(b->t - M_PI);
+  long double alpha_1 = -gains->kp * e1 - gains->kd * a->w;
+  long double alpha_2 = -gains->kp * e2 - gains->kd * b->w;
+
+  /* Invert the equations of motion used by lagrange() */
+  long double b_a = (b->l / a->l);
+  long double a_b = (a->l / b->l);
+  long double total_mass = (a->m + b->m);
+
+  long double accel_1 = b_a * (b->m / total_mass) * cosl(a->t - b->t);
+  long double accel_2 = a_b * cosl(a->t - b->t);
+
+  long double force_1 =
+      -b_a * (b->m / total_mass) * (b->w * b->w) * sinl(a->t - b->t) -
+      (G / a->l) * sinl(a->t);
+  long double force_2 =
+      a_b * (a->w * a->w) * sinl(a->t - b->t) - (G / b->l) * sinl(b->t);
+
+  a->torque = total_mass * a->l * a->l * (alpha_1 + accel_1 * alpha_2 - force_1);
+  b->torque = b->m * b->l * b->l * (alpha_2 + accel_2 * alpha_1 - force_2);
+}
+
+static void setupThread(const RealtimeConfig *cfg) {
+  if (cfg->cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cfg->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      printf("Could not pin to cpu %d: %s\n", cfg->cpu, strerror(errno));
+    }
+  }
+
+  struct sched_param param = {.sched_priority = 80};
+  if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+    printf("SCHED_FIFO unavailable (%s), running best-effort\n",
+           strerror(errno));
+  }
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    printf("mlockall failed: %s\n", strerror(errno));
+  }
+}
+
+/* Sleep until spin_ns before the deadline, then spin the rest of the way */
+static long long waitUntil(long long deadline, long spin_ns) {
+  long long wake = deadline - spin_ns;
+  struct timespec ts = {.tv_sec = wake / NSEC, .tv_nsec = wake % NSEC};
+
+  if (nowNs() < wake) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+  }
+
+  long long now;
+  while ((now = nowNs()) < deadline)
+    ;
+  return now;
+}
+
+static int log2Bucket(long ns) {
+  int i = 0;
+  while (ns > 1 && i < JITTER_BINS - 1) {
+    ns >>= 1;
+    i++;
+  }
+  return i;
+}
+
+int runRealtime(Body *a, Body *b, const RealtimeConfig *cfg,
+                RealtimeStats *stats) {
+  if (cfg->rate <= 0) {
+    printf("Invalid loop rate %d\n", cfg->rate);
+    return 1;
+  }
+
+  memset(stats, 0, sizeof(*stats));
+  setupThread(cfg);
+
+  long period = NSEC / cfg->rate;
+  long double dt = 1.0L / cfg->rate;
+  long total = (long)(cfg->seconds * cfg->rate);
+  long double sim_time = 0;
+
+  long long deadline = nowNs() + period;
+
+  for (long i = 0; i < total; i++) {
+    long long woke = waitUntil(deadline, cfg->spin_ns);
+
+    long jitter = woke - deadline;
+    stats->jitter[log2Bucket(jitter)]++;
+    stats->sum_jitter_ns += jitter;
+    if (jitter > stats->max_jitter_ns) {
+      stats->max_jitter_ns = jitter;
+    }
+
+    if (cfg->controller) {
+      cfg->controller(a, b, sim_time, cfg->ctx);
+    }
+    stepPositions(a, b, dt);
+    sim_time += dt;
+    stats->iterations++;
+    /* Counted a second's worth at a time, off the per-step path */
+    if (stats->iterations % cfg->rate == 0) {
+      metricsAdd(COUNTER_STEPS, cfg->rate);
+      metricsAdd(COUNTER_LAGRANGE, 4 * cfg->rate);
+    }
+
+    deadline += period;
+
+    /* Finished after the next deadline: record how many periods we lost and
+     * drop them rather than trying to catch up with a burst of steps */
+    long long done = nowNs();
+    if (done > deadline) {
+      long late = (done - deadline) / period + 1;
+      stats->misses++;
+      stats->overrun[late < MISS_BINS ? late - 1 : MISS_BINS - 1]++;
+      deadline += late * period;
+    }
+  }
+  metricsAdd(COUNTER_STEPS, stats->iterations % cfg->rate);
+  metricsAdd(COUNTER_LAGRANGE, 4 * (stats->iterations % cfg->rate));
+
+  return 0;
+}
+
+void printRealtimeStats(FILE *out, const RealtimeConfig *cfg,
+                        const RealtimeStats *stats) {
+  fprintf(out, "%ld iterations at %d Hz, %ld deadline misses (%.4f%%)\n",
+          stats->iterations, cfg->rate, stats->misses,
+          stats->iterations ? 100.0 * stats->misses / stats->iterations : 0.0);
+  fprintf(out, "jitter: mean %.0Lf ns, max %ld ns\n",
+          stats->iterations ? stats->sum_jitter_ns / stats->iterations : 0.0L,
+          stats->max_jitter_ns);
+
+  fprintf(out, "\njitter histogram\n");
+  for (int i = 0; i < JITTER_BINS; i++) {
+    if (stats->jitter[i]) {
+      fprintf(out, "  < %10ld ns: %ld\n", 2L << i, stats->jitter[i]);
+    }
+  }
+
+  if (stats->misses) {
+    fprintf(out, "\ndeadline miss histogram\n");
+    for (int i = 0; i < MISS_BINS; i++) {
+      if (stats->overrun[i]) {
+        fprintf(out, "  %s%2d periods lost: %ld\n",
+                i == MISS_BINS - 1 ? ">=" : "  ", i + 1, stats->overrun[i]);
+      }
+    }
+  }
+}
+
+/* double-pendulum --realtime [--rate HZ] [--cpu N] [--seconds S]
+ *                            [--spin NS] [--free] */
+int realtimeMain(int argc, char **argv) {
+  UprightGains gains = {.kp = 100.0, .kd = 20.0};
+  RealtimeConfig cfg = {.rate = 1000,
+                        .cpu = -1,
+                        .spin_ns = 50000,
+                        .seconds = 10.0,
+                        .controller = uprightController,
+                        .ctx = &gains};
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+      cfg.rate = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--cpu") && i + 1 < argc) {
+      cfg.cpu = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      cfg.seconds = strtold(argv[++i], NULL);
+    } else if (!strcmp(argv[i], "--spin") && i + 1 < argc) {
+      cfg.spin_ns = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--free")) {
+      cfg.controller = NULL;
+    }
+  }
+
+  if (cfg.rate < 1000 || cfg.rate > 10000) {
+    printf("Loop rate must be between 1000 and 10000 Hz\n");
+    return 1;
+  }
+
+  /* Start near the top so the controller has something to catch */
+  Body a = {.l = 1.0, .m = 1.0, .t = M_PI - 0.2, .w = 0.0};
+  Body b = {.l = 1.0, .m = 1.0, .t = M_PI + 0.3, .w = 0.0};
+
+  RealtimeStats stats;
+  if (runRealtime(&a, &b, &cfg, &stats) != 0) {
+    return 1;
+  }
+
+  printRealtimeStats(stdout, &cfg, &stats);
+  printf("\nfinal state: t1 = %.6Lf, t2 = %.6Lf, w1 = %.6Lf, w2 = %.6Lf\n",
+         a.t, b.t, a.w, b.w);
+  return 0;
+}
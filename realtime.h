@@ -0,0 +1,49 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include "pendulum.h"
+
+#include <stdio.h>
+
+/* Called once per control period before the plant is stepped. Sets
+ * a->torque and b->torque from the current state. */
+typedef void (*Controller)(Body *a, Body *b, long double time, void *ctx);
+
+#define JITTER_BINS 32 // log2(ns) buckets, last one catches everything above
+#define MISS_BINS 16   // periods overrun, last one catches everything above
+
+typedef struct RealtimeConfig {
+  int rate;          // Loop rate (Hz)
+  int cpu;           // Core to pin to, -1 to leave unpinned
+  long spin_ns;      // Busy-wait this long before each deadline
+  long double seconds;
+  Controller controller;
+  void *ctx;
+} RealtimeConfig;
+
+typedef struct RealtimeStats {
+  long iterations;
+  long misses;
+  long max_jitter_ns;
+  long double sum_jitter_ns;
+  long jitter[JITTER_BINS];
+  long overrun[MISS_BINS];
+} RealtimeStats;
+
+/* Gains for uprightController */
+typedef struct UprightGains {
+  long double kp;
+  long double kd;
+} UprightGains;
+
+/* Computed-torque controller holding both segments inverted */
+void uprightController(Body *a, Body *b, long double time, void *ctx);
+
+int runRealtime(Body *a, Body *b, const RealtimeConfig *cfg,
+                RealtimeStats *stats);
+void printRealtimeStats(FILE *out, const RealtimeConfig *cfg,
+                        const RealtimeStats *stats);
+
+int realtimeMain(int argc, char **argv);
+
+#endif
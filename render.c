@@ -0,0 +1,579 @@
+#include "render.h"
+#include "budget.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROJECT_BLOCK 256 // Lanes projected to pixels at a time
+#define FULL_LANES 64 // Most pendulums drawn in full
+#define TIP_PIXELS 8 // Pixels per joint below which joints become density
+#define DENSITY_DECAY 0.85f // Per frame, so the map leaves short trails
+#define DENSITY_HALF 2.0f // Joints per pixel at half brightness
+#define DENSITY_LANES 1 // Lanes per viewport pixel projected in density mode
+#define TRAIL_SUBSTEPS 4 // Points per step offered to a trail's sampler
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+#define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
+
+void viewReset(View *v, SDL_Rect rect, double l1, double l2) {
+  v->rect = rect;
+  v->cx = 0;
+  v->cy = 0;
+  v->scale = 0.8 * MIN(rect.w / 2, rect.h / 2) / (l1 + l2);
+}
+
+void viewZoom(View *v, double factor, int x, int y) {
+  double px = x - v->rect.x - v->rect.w / 2.0;
+  double py = y - v->rect.y - v->rect.h / 2.0;
+  v->cx += px / v->scale * (1 - 1 / factor);
+  v->cy += py / v->scale * (1 - 1 / factor);
+  v->scale *= factor;
+}
+
+void viewPan(View *v, int dx, int dy) {
+  v->cx -= dx / v->scale;
+  v->cy -= dy / v->scale;
+}
+
+void viewLayout(View *views, int n, SDL_Rect area, double l1, double l2) {
+  int cols = ceil(sqrt((double)n * area.w / area.h));
+  int rows = (n + cols - 1) / cols;
+  for (int s = 0; s < n; s++) {
+    int col = s % cols, row = s / cols;
+    int x0 = col * area.w / cols, x1 = (col + 1) * area.w / cols;
+    int y0 = row * area.h / rows, y1 = (row + 1) * area.h / rows;
+    SDL_Rect cell = {area.x + x0, area.y + y0, x1 - x0, y1 - y0};
+    viewReset(&views[s], cell, l1, l2);
+  }
+}
+
+void viewWorld(const View *v, int x, int y, double *wx, double *wy) {
+  *wx = v->cx + (x - v->rect.x - v->rect.w / 2.0) / v->scale;
+  *wy = v->cy + (y - v->rect.y - v->rect.h / 2.0) / v->scale;
+}
+
+View *viewAt(View *views, int n, int x, int y) {
+  for (int s = 0; s < n; s++) {
+    const SDL_Rect *r = &views[s].rect;
+    if (x >= r->x && x < r->x + r->w && y >= r->y && y < r->y + r->h) {
+      return &views[s];
+    }
+  }
+  return NULL;
+}
+
+int canvasInit(Canvas *c, SDL_Renderer *renderer, size_t n,
+               size_t trail_stride) {
+  memset(c, 0, sizeof(Canvas));
+  c->renderer = renderer;
+  c->trail_stride = trail_stride;
+  c->n_trails = MIN((n + trail_stride - 1) / trail_stride, TRAIL_LANES);
+  c->trails = budgetAlloc(MEM_TRAILS, c->n_trails * sizeof(Trail));
+  c->trail_tolerance = 1e-3;
+  c->points_cap = MAX(2 * n, TRAIL_SIZE + 1);
+  c->points = budgetAlloc(MEM_TRAILS, c->points_cap * sizeof(SDL_FPoint));
+  if (c->trails == NULL || c->points == NULL) {
+    canvasFree(c);
+    return 1;
+  }
+  return 0;
+}
+
+void canvasFree(Canvas *c) {
+  budgetFree(c->trails);
+  budgetFree(c->points);
+  free(c->density);
+  free(c->vertices);
+  free(c->indices);
+  if (c->texture) {
+    SDL_DestroyTexture(c->texture);
+  }
+  memset(c, 0, sizeof(Canvas));
+}
+
+static void trailAppend(Trail *t, const double *p) {
+  t->points[t->idx].x = p[0];
+  t->points[t->idx].y = p[1];
+  t->idx = (t->idx + 1) % TRAIL_SIZE;
+  t->n_elements = MIN(t->n_elements + 1, TRAIL_SIZE);
+}
+
+void canvasTrails(Canvas *c, const Ensemble *e) {
+  for (int k = 0; k < c->n_trails; k++) {
+    Trail *t = &c->trails[k];
+    size_t i = k * c->trail_stride;
+
+    if (t->n_elements == 0) {
+      double tip[2] = {e->l1 * sin(e->t1[i]) + e->l2 * sin(e->t2[i]),
+                       e->l1 * cos(e->t1[i]) + e->l2 * cos(e->t2[i])};
+      trailAppend(t, tip);
+      samplerInit(&t->sampler, c->trail_tolerance, tip);
+    } else {
+      /* Tips along the step, from the angles' Hermite interpolants */
+      for (int j = 1; j <= TRAIL_SUBSTEPS; j++) {
+        double u = (double)j / TRAIL_SUBSTEPS;
+        double t1 = hermite(t->t1, t->w1, e->t1[i], e->w1[i], DT, u);
+        double t2 = hermite(t->t2, t->w2, e->t2[i], e->w2[i], DT, u);
+        double tip[2] = {e->l1 * sin(t1) + e->l2 * sin(t2),
+                         e->l1 * cos(t1) + e->l2 * cos(t2)};
+        if (samplerPush(&t->sampler, tip, 0)) {
+          trailAppend(t, t->sampler.anchor);
+        }
+      }
+    }
+
+    t->t1 = e->t1[i];
+    t->t2 = e->t2[i];
+    t->w1 = e->w1[i];
+    t->w2 = e->w2[i];
+  }
+}
+
+void canvasClearTrails(Canvas *c) {
+  memset(c->trails, 0, c->n_trails * sizeof(Trail));
+}
+
+static const Trail *trailOf(const Canvas *c, size_t lane) {
+  size_t k = lane / c->trail_stride;
+  if (lane % c->trail_stride || k >= (size_t)c->n_trails) {
+    return NULL;
+  }
+  return &c->trails[k];
+}
+
+typedef struct Frame {
+  float ox, oy; // Pivot in pixels
+  float scale;
+  float x0, y0, x1, y1; // Viewport bounds in pixels
+} Frame;
+
+static void frameOf(const View *v, Frame *f) {
+  f->scale = v->scale;
+  f->ox = v->rect.x + v->rect.w / 2.0 - v->cx * v->scale;
+  f->oy = v->rect.y + v->rect.h / 2.0 - v->cy * v->scale;
+  f->x0 = v->rect.x;
+  f->y0 = v->rect.y;
+  f->x1 = v->rect.x + v->rect.w;
+  f->y1 = v->rect.y + v->rect.h;
+}
+
+static int inFrame(const Frame *f, float x, float y) {
+  return x >= f->x0 && x < f->x1 && y >= f->y0 && y < f->y1;
+}
+
+/* Whether the bounding box of a segment overlaps the viewport */
+static int segmentInFrame(const Frame *f, float ax, float ay, float bx,
+                          float by) {
+  return MAX(ax, bx) >= f->x0 && MIN(ax, bx) < f->x1 && MAX(ay, by) >= f->y0 &&
+         MIN(ay, by) < f->y1;
+}
+
+/* A trail in pixels, oldest point first and ending at the tip (tx, ty) so
+ * it reaches past the last point its sampler kept */
+static int trailPixels(const Canvas *c, const Frame *f, const Trail *t,
+                       float tx, float ty) {
+  int first = (t->idx - t->n_elements + TRAIL_SIZE) % TRAIL_SIZE;
+  for (int p = 0; p < t->n_elements; p++) {
+    const SDL_FPoint *q = &t->points[(first + p) % TRAIL_SIZE];
+    c->points[p].x = f->ox + f->scale * q->x;
+    c->points[p].y = f->oy + f->scale * q->y;
+  }
+  c->points[t->n_elements].x = tx;
+  c->points[t->n_elements].y = ty;
+  return t->n_elements + 1;
+}
+
+static void drawFull(Canvas *c, const Frame *f, const Ensemble *e,
+                     const size_t *lanes, size_t n) {
+  for (size_t k = 0; k < n; k++) {
+    size_t i = lanes[k];
+    float ax = f->ox + f->scale * e->l1 * sin(e->t1[i]);
+    float ay = f->oy + f->scale * e->l1 * cos(e->t1[i]);
+    float bx = ax + f->scale * e->l2 * sin(e->t2[i]);
+    float by = ay + f->scale * e->l2 * cos(e->t2[i]);
+
+    if (segmentInFrame(f, f->ox, f->oy, ax, ay)) {
+      SDL_SetRenderDrawColor(c->renderer, c->arm1.r, c->arm1.g, c->arm1.b,
+                             c->arm1.a);
+      SDL_RenderDrawLineF(c->renderer, f->ox, f->oy, ax, ay);
+    }
+    if (segmentInFrame(f, ax, ay, bx, by)) {
+      SDL_SetRenderDrawColor(c->renderer, c->arm2.r, c->arm2.g, c->arm2.b,
+                             c->arm2.a);
+      SDL_RenderDrawLineF(c->renderer, ax, ay, bx, by);
+    }
+
+    const Trail *t = trailOf(c, i);
+    if (t == NULL) {
+      continue;
+    }
+
+    /* Runs of segments in view, each as one polyline */
+    SDL_SetRenderDrawColor(c->renderer, c->trail.r, c->trail.g, c->trail.b,
+                           c->trail.a);
+    int m = trailPixels(c, f, t, bx, by);
+    int run = 0;
+    for (int p = 1; p <= m; p++) {
+      if (p < m && segmentInFrame(f, c->points[p - 1].x, c->points[p - 1].y,
+                                  c->points[p].x, c->points[p].y)) {
+        continue;
+      }
+      if (p - 1 > run) {
+        SDL_RenderDrawLinesF(c->renderer, c->points + run, p - run);
+      }
+      run = p;
+    }
+  }
+}
+
+static int densityTexture(Canvas *c, const View *v) {
+  if (c->texture && c->tex_w == v->rect.w && c->tex_h == v->rect.h) {
+    return 0;
+  }
+  if (c->texture) {
+    SDL_DestroyTexture(c->texture);
+  }
+  free(c->density);
+
+  c->tex_w = v->rect.w;
+  c->tex_h = v->rect.h;
+  c->texture = SDL_CreateTexture(c->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                 SDL_TEXTUREACCESS_STREAMING, c->tex_w,
+                                 c->tex_h);
+  c->density = calloc((size_t)c->tex_w * c->tex_h, sizeof(float));
+  return c->texture == NULL || c->density == NULL;
+}
+
+/* Fade the previous map, add this frame's joints, each standing for weight
+ * of them, and upload it. Costs one pass over the viewport's pixels plus
+ * one add per visible joint. */
+static void drawDensity(Canvas *c, const View *v, size_t n_joints,
+                        float weight, int fresh) {
+  if (densityTexture(c, v)) {
+    return;
+  }
+
+  size_t pixels = (size_t)c->tex_w * c->tex_h;
+  float decay = fresh ? 0.0f : DENSITY_DECAY;
+  for (size_t p = 0; p < pixels; p++) {
+    c->density[p] *= decay;
+  }
+  for (size_t k = 0; k < n_joints; k++) {
+    int x = (int)c->points[k].x - v->rect.x;
+    int y = (int)c->points[k].y - v->rect.y;
+    c->density[(size_t)y * c->tex_w + x] += weight;
+  }
+
+  void *pixels_out;
+  int pitch;
+  if (SDL_LockTexture(c->texture, NULL, &pixels_out, &pitch) != 0) {
+    return;
+  }
+  int w = c->tex_w;
+  float bg[3] = {c->background.r, c->background.g, c->background.b};
+  float span[3] = {c->trail.r - bg[0], c->trail.g - bg[1], c->trail.b - bg[2]};
+  for (int y = 0; y < c->tex_h; y++) {
+    uint32_t *row = (uint32_t *)((uint8_t *)pixels_out + (size_t)y * pitch);
+    const float *d = c->density + (size_t)y * w;
+    for (int x = 0; x < w; x++) {
+      float f = d[x] / (d[x] + DENSITY_HALF);
+      int r = bg[0] + f * span[0];
+      int g = bg[1] + f * span[1];
+      int b = bg[2] + f * span[2];
+      row[x] = 0xff000000u | r << 16 | g << 8 | b;
+    }
+  }
+  SDL_UnlockTexture(c->texture);
+  SDL_RenderCopy(c->renderer, c->texture, NULL, &v->rect);
+}
+
+/* Project every stride-th lane from first up to end, keeping the joints
+ * that land in view and the first few pendulums with any part in view */
+static void project(Canvas *c, const Frame *f, const Ensemble *e,
+                    size_t first, size_t end, size_t stride, size_t *lanes,
+                    size_t *visible, size_t *n_joints) {
+  float ax[PROJECT_BLOCK], ay[PROJECT_BLOCK];
+  float bx[PROJECT_BLOCK], by[PROJECT_BLOCK];
+  double g1[PROJECT_BLOCK], g2[PROJECT_BLOCK];
+  double l1 = e->l1 * f->scale;
+  double l2 = e->l2 * f->scale;
+  *visible = 0;
+  *n_joints = 0;
+
+  for (size_t begin = first; begin < end; begin += PROJECT_BLOCK * stride) {
+    size_t n = MIN((end - begin + stride - 1) / stride, PROJECT_BLOCK);
+    const double *t1 = e->t1 + begin;
+    const double *t2 = e->t2 + begin;
+    if (stride > 1) {
+      /* Gathered first, so the loop below stays vectorized */
+      for (size_t i = 0; i < n; i++) {
+        g1[i] = t1[i * stride];
+        g2[i] = t2[i * stride];
+      }
+      t1 = g1;
+      t2 = g2;
+    }
+    for (size_t i = 0; i < n; i++) {
+      ax[i] = f->ox + l1 * sin(t1[i]);
+      ay[i] = f->oy + l1 * sin(t1[i] + M_PI_2);
+      bx[i] = ax[i] + l2 * sin(t2[i]);
+      by[i] = ay[i] + l2 * sin(t2[i] + M_PI_2);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      if (inFrame(f, ax[i], ay[i])) {
+        c->points[*n_joints].x = ax[i];
+        c->points[*n_joints].y = ay[i];
+        ++*n_joints;
+      }
+      if (inFrame(f, bx[i], by[i])) {
+        c->points[*n_joints].x = bx[i];
+        c->points[*n_joints].y = by[i];
+        ++*n_joints;
+      }
+      if (segmentInFrame(f, f->ox, f->oy, ax[i], ay[i]) ||
+          segmentInFrame(f, ax[i], ay[i], bx[i], by[i])) {
+        if (*visible < FULL_LANES) {
+          lanes[*visible] = begin + i * stride;
+        }
+        ++*visible;
+      }
+    }
+  }
+}
+
+/* Project lanes [begin, end), every stride-th from begin + offset, and
+ * pick how much of them to draw. Leaving density mode needs every lane
+ * again, so a sample that turns out not to need it is projected in full. */
+static Detail selectDetail(Canvas *c, const Frame *f, const Ensemble *e,
+                           size_t begin, size_t end, size_t offset,
+                           size_t *stride, size_t pixels, size_t *lanes,
+                           size_t *visible, size_t *n_joints) {
+  for (;;) {
+    project(c, f, e, begin + offset, end, *stride, lanes, visible, n_joints);
+    Detail detail;
+    if (*visible * *stride <= FULL_LANES) {
+      detail = DETAIL_FULL;
+    } else if (*n_joints * *stride * TIP_PIXELS <= pixels) {
+      detail = DETAIL_JOINTS;
+    } else {
+      detail = DETAIL_DENSITY;
+    }
+    if (detail == DETAIL_DENSITY || *stride == 1) {
+      return detail;
+    }
+    *stride = 1;
+    offset = 0;
+  }
+}
+
+void canvasDraw(Canvas *c, const View *v, const Ensemble *e) {
+  Frame f;
+  frameOf(v, &f);
+
+  /* Once the view is a density map, only a pixel's worth of lanes is
+   * projected per frame, a different slice each time, so the cost follows
+   * the pixels. The fading map blends the slices back together. */
+  size_t pixels = (size_t)v->rect.w * v->rect.h;
+  size_t stride = 1;
+  if (c->detail == DETAIL_DENSITY && e->n > pixels * DENSITY_LANES) {
+    stride = e->n / (pixels * DENSITY_LANES);
+  }
+  size_t offset = c->slice++ % stride;
+
+  size_t lanes[FULL_LANES];
+  size_t visible, n_joints;
+  Detail previous = c->detail;
+  c->detail = selectDetail(c, &f, e, 0, e->n, offset, &stride, pixels, lanes,
+                           &visible, &n_joints);
+  c->visible = visible * stride;
+
+  if (c->detail == DETAIL_FULL) {
+    drawFull(c, &f, e, lanes, visible);
+  } else if (c->detail == DETAIL_JOINTS) {
+    SDL_SetRenderDrawColor(c->renderer, c->arm2.r, c->arm2.g, c->arm2.b,
+                           c->arm2.a);
+    SDL_RenderDrawPointsF(c->renderer, c->points, n_joints);
+  } else {
+    drawDensity(c, v, n_joints, stride, previous != DETAIL_DENSITY);
+  }
+}
+
+static SDL_Color sdlColor(Color c) {
+  return (SDL_Color){.r = c.r, .g = c.g, .b = c.b, .a = c.a};
+}
+
+/* Append a quad with corners p[0..3] in order as two triangles */
+static void quad(Canvas *c, size_t *nv, size_t *ni, const SDL_FPoint *p,
+                 SDL_Color color) {
+  SDL_Vertex *v = c->vertices + *nv;
+  int *idx = c->indices + *ni;
+  for (int k = 0; k < 4; k++) {
+    v[k].position = p[k];
+    v[k].color = color;
+    v[k].tex_coord = (SDL_FPoint){0, 0};
+  }
+  int base = *nv;
+  idx[0] = base;
+  idx[1] = base + 1;
+  idx[2] = base + 2;
+  idx[3] = base;
+  idx[4] = base + 2;
+  idx[5] = base + 3;
+  *nv += 4;
+  *ni += 6;
+}
+
+static void rectQuad(Canvas *c, size_t *nv, size_t *ni, float x, float y,
+                     float w, float h, SDL_Color color) {
+  SDL_FPoint p[4] = {{x, y}, {x + w, y}, {x + w, y + h}, {x, y + h}};
+  quad(c, nv, ni, p, color);
+}
+
+/* A one pixel wide line as a quad */
+static void lineQuad(Canvas *c, size_t *nv, size_t *ni, float x0, float y0,
+                     float x1, float y1, SDL_Color color) {
+  float dx = x1 - x0, dy = y1 - y0;
+  float len = sqrtf(dx * dx + dy * dy);
+  if (len < 1e-3f) {
+    rectQuad(c, nv, ni, x0, y0, 1, 1, color);
+    return;
+  }
+  float nx = -dy / len * 0.5f, ny = dx / len * 0.5f;
+  SDL_FPoint p[4] = {{x0 + nx, y0 + ny},
+                     {x0 - nx, y0 - ny},
+                     {x1 - nx, y1 - ny},
+                     {x1 + nx, y1 + ny}};
+  quad(c, nv, ni, p, color);
+}
+
+static int reserveQuads(Canvas *c, size_t quads) {
+  if (quads * 4 <= c->vertices_cap) {
+    return 0;
+  }
+  quads = MAX(quads, c->vertices_cap / 2);
+  SDL_Vertex *v = realloc(c->vertices, quads * 4 * sizeof(SDL_Vertex));
+  if (v == NULL) {
+    return 1;
+  }
+  c->vertices = v;
+  int *idx = realloc(c->indices, quads * 6 * sizeof(int));
+  if (idx == NULL) {
+    return 1;
+  }
+  c->indices = idx;
+  c->vertices_cap = quads * 4;
+  return 0;
+}
+
+/* Append the quads for lanes [begin, end) of one scene. Like canvasDraw,
+ * crowded scenes fall back to joints, and past that to a pixel's worth of
+ * sampled joints, so the quads follow the scene's pixels, not its lanes. */
+static int sceneQuads(Canvas *c, const View *v, const Ensemble *e,
+                      size_t begin, size_t end, size_t *nv, size_t *ni) {
+  Frame f;
+  frameOf(v, &f);
+  if (reserveQuads(c, *nv / 4 + 4)) {
+    return 1;
+  }
+  SDL_Color border = sdlColor(c->border);
+  rectQuad(c, nv, ni, f.x0, f.y0, v->rect.w, 1, border);
+  rectQuad(c, nv, ni, f.x0, f.y1 - 1, v->rect.w, 1, border);
+  rectQuad(c, nv, ni, f.x0, f.y0, 1, v->rect.h, border);
+  rectQuad(c, nv, ni, f.x1 - 1, f.y0, 1, v->rect.h, border);
+
+  size_t pixels = (size_t)v->rect.w * v->rect.h;
+  size_t stride = 1;
+  if (end - begin > pixels * DENSITY_LANES) {
+    stride = (end - begin) / (pixels * DENSITY_LANES);
+  }
+  size_t lanes[FULL_LANES];
+  size_t visible, n_joints;
+  Detail detail = selectDetail(c, &f, e, begin, end, c->slice % stride,
+                               &stride, pixels, lanes, &visible, &n_joints);
+  c->detail = MAX(c->detail, detail);
+  c->visible += visible * stride;
+
+  if (detail != DETAIL_FULL) {
+    if (reserveQuads(c, *nv / 4 + n_joints)) {
+      return 1;
+    }
+    SDL_Color color = sdlColor(detail == DETAIL_JOINTS ? c->arm2 : c->trail);
+    for (size_t k = 0; k < n_joints; k++) {
+      rectQuad(c, nv, ni, c->points[k].x, c->points[k].y, 1, 1, color);
+    }
+    return 0;
+  }
+
+  SDL_Color arm1 = sdlColor(c->arm1);
+  SDL_Color arm2 = sdlColor(c->arm2);
+  SDL_Color trail = sdlColor(c->trail);
+  for (size_t k = 0; k < visible; k++) {
+    size_t i = lanes[k];
+    float ax = f.ox + f.scale * e->l1 * sin(e->t1[i]);
+    float ay = f.oy + f.scale * e->l1 * cos(e->t1[i]);
+    float bx = ax + f.scale * e->l2 * sin(e->t2[i]);
+    float by = ay + f.scale * e->l2 * cos(e->t2[i]);
+
+    const Trail *t = trailOf(c, i);
+    int m = t ? trailPixels(c, &f, t, bx, by) : 0;
+    if (reserveQuads(c, *nv / 4 + m + 2)) {
+      return 1;
+    }
+    for (int p = 1; p < m; p++) {
+      const SDL_FPoint *q = c->points + p - 1;
+      if (segmentInFrame(&f, q[0].x, q[0].y, q[1].x, q[1].y)) {
+        lineQuad(c, nv, ni, q[0].x, q[0].y, q[1].x, q[1].y, trail);
+      }
+    }
+    if (segmentInFrame(&f, f.ox, f.oy, ax, ay)) {
+      lineQuad(c, nv, ni, f.ox, f.oy, ax, ay, arm1);
+    }
+    if (segmentInFrame(&f, ax, ay, bx, by)) {
+      lineQuad(c, nv, ni, ax, ay, bx, by, arm2);
+    }
+  }
+  return 0;
+}
+
+void canvasDrawScenes(Canvas *c, const View *views, int n_scenes,
+                      size_t per_scene, const Ensemble *e) {
+  size_t nv = 0, ni = 0;
+  c->detail = DETAIL_FULL;
+  c->visible = 0;
+  for (int s = 0; s < n_scenes; s++) {
+    size_t begin = MIN(s * per_scene, e->n);
+    size_t end = MIN(begin + per_scene, e->n);
+    if (sceneQuads(c, &views[s], e, begin, end, &nv, &ni)) {
+      break;
+    }
+  }
+  c->slice++;
+  SDL_RenderGeometry(c->renderer, NULL, c->vertices, nv, c->indices, ni);
+}
+
+void canvasDrawPaths(Canvas *c, const View *v, const SDL_FPoint *paths,
+                     int n_paths, int n_points) {
+  Frame f;
+  frameOf(v, &f);
+  /* Paths longer than the point buffer are cut short, but still laid out
+   * n_points apart */
+  int drawn = MIN(n_points, (int)c->points_cap);
+
+  /* The others halfway to the background, then the first on top */
+  Color dim = {.r = (c->trail.r + c->background.r) / 2,
+               .g = (c->trail.g + c->background.g) / 2,
+               .b = (c->trail.b + c->background.b) / 2,
+               .a = c->trail.a};
+  for (int k = n_paths - 1; k >= 0; k--) {
+    const SDL_FPoint *path = paths + (size_t)k * n_points;
+    for (int p = 0; p < drawn; p++) {
+      c->points[p].x = f.ox + f.scale * path[p].x;
+      c->points[p].y = f.oy + f.scale * path[p].y;
+    }
+    Color col = k ? dim : c->trail;
+    SDL_SetRenderDrawColor(c->renderer, col.r, col.g, col.b, col.a);
+    SDL_RenderDrawLinesF(c->renderer, c->points, drawn);
+  }
+}
@@ -0,0 +1,113 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <SDL2/SDL.h>
+#include <stddef.h>
+
+#include "ensemble.h"
+#include "pendulum.h"
+#include "sample.h"
+
+#define TRAIL_SIZE 1024
+#define TRAIL_LANES 64 // Lanes that keep a trail
+
+/* Maps world coordinates (metres from the pivot, y down) to a viewport */
+typedef struct View {
+  SDL_Rect rect; // Viewport in window pixels
+  double cx, cy; // World point at the centre of the viewport
+  double scale;  // Pixels per metre
+} View;
+
+/* Fit two arms of length l1 and l2 into the viewport */
+void viewReset(View *v, SDL_Rect rect, double l1, double l2);
+
+/* Zoom by factor keeping the world point under window pixel (x, y) fixed */
+void viewZoom(View *v, double factor, int x, int y);
+void viewPan(View *v, int dx, int dy);
+
+/* Tile area with n roughly square views in rows, each fitted like
+ * viewReset() */
+void viewLayout(View *views, int n, SDL_Rect area, double l1, double l2);
+
+/* World point under window pixel (x, y) */
+void viewWorld(const View *v, int x, int y, double *wx, double *wy);
+
+/* The view containing window pixel (x, y), NULL if none */
+View *viewAt(View *views, int n, int x, int y);
+
+/* Tip positions kept by a sampler fed from the integrator's dense output,
+ * so a trail holds as many points as the path's curvature needs rather
+ * than one per frame */
+typedef struct Trail {
+  int idx;
+  int n_elements;
+  SDL_FPoint points[TRAIL_SIZE]; // World coordinates
+  Sampler sampler;
+  double t1, t2, w1, w2; // Lane state at the last update
+} Trail;
+
+/* How much of each pendulum gets drawn, picked per frame from how many are
+ * in view and how crowded the pixels they land on are */
+typedef enum Detail {
+  DETAIL_FULL,   // Arms and trails
+  DETAIL_JOINTS, // One point per elbow and tip
+  DETAIL_DENSITY // Joints accumulated per pixel into a fading texture
+} Detail;
+
+typedef struct Canvas {
+  SDL_Renderer *renderer;
+  Color background, arm1, arm2, trail, border;
+
+  Trail *trails; // For every trail_stride-th lane
+  int n_trails;
+  size_t trail_stride;
+  double trail_tolerance; // Metres a trail may stray from the tip's path
+
+  SDL_FPoint *points; // Culled joints or trail points, in pixels
+  size_t points_cap;
+
+  /* Density mode, sized to the viewport */
+  SDL_Texture *texture;
+  float *density;
+  int tex_w, tex_h;
+
+  /* Scene geometry, rebuilt every frame */
+  SDL_Vertex *vertices;
+  int *indices;
+  size_t vertices_cap;
+
+  /* Stats of the last frame */
+  Detail detail;
+  size_t visible; // Estimated from a sample of the lanes in density mode
+  size_t slice;   // Counts frames, to pick the lanes density mode samples
+} Canvas;
+
+int canvasInit(Canvas *c, SDL_Renderer *renderer, size_t n,
+               size_t trail_stride);
+void canvasFree(Canvas *c);
+
+/* Extend the trails over the step just taken, once per DT step */
+void canvasTrails(Canvas *c, const Ensemble *e);
+
+/* Forget every trail, for when the lanes jump to another time */
+void canvasClearTrails(Canvas *c);
+
+/* Draw every lane of e that falls inside the view. Off-screen pendulums,
+ * arm segments and trail points are culled, and crowded views fall back to
+ * joints or a density map. The density map is built from a rotating sample
+ * of the lanes, so its cost follows the pixels, not the lanes. */
+void canvasDraw(Canvas *c, const View *v, const Ensemble *e);
+
+/* Small multiples: scene s shows lanes [s * per_scene, (s + 1) * per_scene)
+ * in views[s]. Each scene is culled to its own viewport and picks its own
+ * detail as canvasDraw does, and all of them go to the renderer as one
+ * batch of triangles. */
+void canvasDrawScenes(Canvas *c, const View *views, int n_scenes,
+                      size_t per_scene, const Ensemble *e);
+
+/* n_paths paths of n_points world points each, one after the other, as
+ * lines. The first is drawn in the trail colour over dimmer others. */
+void canvasDrawPaths(Canvas *c, const View *v, const SDL_FPoint *paths,
+                     int n_paths, int n_points);
+
+#endif
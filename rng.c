@@ -0,0 +1,61 @@
+#include "rng.h"
+
+#include <math.h>
+
+#define RNG_BLOCK 64
+
+/* 53-bit uniform from two words, built from 27 and 26 bit halves so the
+ * conversions stay in signed 32-bit ints and vectorize */
+static inline double uniform53(uint32_t hi, uint32_t lo) {
+  return ((int32_t)(hi >> 5) * 67108864.0 + (int32_t)(lo >> 6)) *
+         (1.0 / 9007199254740992.0);
+}
+
+static void philoxBlock(uint32_t k0, uint32_t k1, uint64_t stream,
+                        uint64_t step, size_t n, uint32_t out[4][RNG_BLOCK]) {
+  for (size_t i = 0; i < n; i++) {
+    uint64_t id = stream + i;
+    uint32_t ctr[4] = {(uint32_t)step, (uint32_t)(step >> 32), (uint32_t)id,
+                       (uint32_t)(id >> 32)};
+    philox4x32(ctr, k0, k1);
+    out[0][i] = ctr[0];
+    out[1][i] = ctr[1];
+    out[2][i] = ctr[2];
+    out[3][i] = ctr[3];
+  }
+}
+
+void philoxUniforms(uint64_t seed, uint64_t stream, uint64_t step, size_t m,
+                    double *restrict u1, double *restrict u2) {
+  uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+  uint32_t out[4][RNG_BLOCK];
+
+  for (size_t s = 0; s < m; s += RNG_BLOCK) {
+    size_t n = m - s < RNG_BLOCK ? m - s : RNG_BLOCK;
+    philoxBlock(k0, k1, stream + s, step, n, out);
+    for (size_t i = 0; i < n; i++) {
+      u1[s + i] = uniform53(out[0][i], out[1][i]);
+      u2[s + i] = uniform53(out[2][i], out[3][i]);
+    }
+  }
+}
+
+void philoxNormals(uint64_t seed, uint64_t stream, uint64_t step, size_t m,
+                   double *restrict z1, double *restrict z2) {
+  uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+  uint32_t out[4][RNG_BLOCK];
+
+  for (size_t s = 0; s < m; s += RNG_BLOCK) {
+    size_t n = m - s < RNG_BLOCK ? m - s : RNG_BLOCK;
+    philoxBlock(k0, k1, stream + s, step, n, out);
+
+    /* Box-Muller, with u1 shifted into (0, 1] to keep log finite */
+    for (size_t i = 0; i < n; i++) {
+      double u1 = 1.0 - uniform53(out[0][i], out[1][i]);
+      double u2 = uniform53(out[2][i], out[3][i]);
+      double r = sqrt(-2.0 * log(u1));
+      z1[s + i] = r * sin(2 * M_PI * u2 + M_PI_2);
+      z2[s + i] = r * sin(2 * M_PI * u2);
+    }
+  }
+}
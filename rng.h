@@ -0,0 +1,41 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+ * 3"). Stateless: the output is a pure function of the key and counter, so
+ * any lane can draw its numbers for any step without touching shared state. */
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+static inline void philox4x32(uint32_t ctr[4], uint32_t k0, uint32_t k1) {
+  for (int r = 0; r < 10; r++) {
+    uint64_t p0 = (uint64_t)PHILOX_M0 * ctr[0];
+    uint64_t p1 = (uint64_t)PHILOX_M1 * ctr[2];
+    uint32_t c0 = (uint32_t)(p1 >> 32) ^ ctr[1] ^ k0;
+    uint32_t c2 = (uint32_t)(p0 >> 32) ^ ctr[3] ^ k1;
+    ctr[1] = (uint32_t)p1;
+    ctr[3] = (uint32_t)p0;
+    ctr[0] = c0;
+    ctr[2] = c2;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+}
+
+/* Two uniforms in [0, 1) for each of m consecutive streams starting at
+ * stream, all at the given step */
+void philoxUniforms(uint64_t seed, uint64_t stream, uint64_t step, size_t m,
+                    double *u1, double *u2);
+
+/* Two standard normals for each of m consecutive streams starting at
+ * stream, all at the given step */
+void philoxNormals(uint64_t seed, uint64_t stream, uint64_t step, size_t m,
+                   double *z1, double *z2);
+
+#endif
@@ -0,0 +1,201 @@
+#include "run.h"
+#include "arrow.h"
+#include "budget.h"
+#include "metrics.h"
+#include "pendulum.h"
+#include "sample.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUN_CHUNK 65536 // Rows buffered per record batch, at most
+#define COUNT_STEPS 4096 // Steps between updates of the step counters
+
+enum { COL_TIME, COL_T1, COL_T2, COL_W1, COL_W2, COL_ENERGY, N_COLS };
+
+static const char *const columns[N_COLS] = {"time",   "theta1", "theta2",
+                                            "omega1", "omega2", "energy"};
+static const ArrowType types[N_COLS] = {ARROW_FLOAT64, ARROW_FLOAT64,
+                                        ARROW_FLOAT64, ARROW_FLOAT64,
+                                        ARROW_FLOAT64, ARROW_FLOAT64};
+
+typedef struct RunOutput {
+  FILE *text;
+  ArrowWriter *arrow;
+  double *cols[N_COLS];
+  int rows;
+  int chunk; // Rows that fit in the buffers
+  double e0; // Energy of the first row, for the drift gauge
+} RunOutput;
+
+static int flush(RunOutput *out) {
+  double *const *cols = out->cols;
+  int rows = out->rows;
+  out->rows = 0;
+  double drift = fabs(cols[COL_ENERGY][rows - 1] - out->e0);
+  metricsSet(GAUGE_ENERGY_DRIFT, out->e0 ? drift / fabs(out->e0) : drift);
+
+  if (out->arrow) {
+    metricsAdd(COUNTER_BYTES, (uint64_t)rows * N_COLS * sizeof(double));
+    return arrowWriteBatch(out->arrow, rows, (const void *const *)cols);
+  }
+
+  uint64_t bytes = 0;
+  for (int i = 0; i < rows; i++) {
+    bytes += fprintf(out->text, "%.9g,%.17g,%.17g,%.17g,%.17g,%.17g\n",
+                     cols[COL_TIME][i], cols[COL_T1][i], cols[COL_T2][i],
+                     cols[COL_W1][i], cols[COL_W2][i], cols[COL_ENERGY][i]);
+  }
+  metricsAdd(COUNTER_BYTES, bytes);
+  return ferror(out->text);
+}
+
+/* Append the state in a and b at time t, flushing full chunks */
+static int addRow(RunOutput *out, double t, Body *a, Body *b) {
+  int r = out->rows;
+  out->cols[COL_TIME][r] = t;
+  out->cols[COL_T1][r] = a->t;
+  out->cols[COL_T2][r] = b->t;
+  out->cols[COL_W1][r] = a->w;
+  out->cols[COL_W2][r] = b->w;
+  out->cols[COL_ENERGY][r] = getKinetic(a, b) + getPotential(a, b);
+  return ++out->rows == out->chunk ? flush(out) : 0;
+}
+
+/* The scalar stepper leaves counting to its callers. stepped is the total
+ * so far, and the counters move once every COUNT_STEPS of them. */
+static void countSteps(long stepped) {
+  if (stepped % COUNT_STEPS == 0) {
+    metricsAdd(COUNTER_STEPS, COUNT_STEPS);
+    metricsAdd(COUNTER_LAGRANGE, 4 * COUNT_STEPS);
+  }
+}
+
+/* double-pendulum --run [--theta1 T1] [--theta2 T2] [--omega1 W1]
+ *     [--omega2 W2] [--seconds T] [--every N] [--tolerance RAD]
+ *     [--output FILE] [--arrow FILE]
+ *
+ * Writes every Nth step as CSV to stdout or --output, or as an Arrow IPC
+ * file with --arrow. With --tolerance only the steps needed to follow
+ * (theta1, theta2) within RAD by straight lines are written, always
+ * including the first and last. */
+int runMain(int argc, char **argv) {
+  Body a = {.l = 1.0, .m = 1.0, .t = 1.8, .w = 0.0};
+  Body b = {.l = 1.0, .m = 1.0, .t = 1.0, .w = 0.0};
+  double seconds = 60.0;
+  long every = 1;
+  double tolerance = 0;
+  const char *output = NULL;
+  const char *arrow_path = NULL;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--theta1") && i + 1 < argc) {
+      a.t = strtold(argv[++i], NULL);
+    } else if (!strcmp(argv[i], "--theta2") && i + 1 < argc) {
+      b.t = strtold(argv[++i], NULL);
+    } else if (!strcmp(argv[i], "--omega1") && i + 1 < argc) {
+      a.w = strtold(argv[++i], NULL);
+    } else if (!strcmp(argv[i], "--omega2") && i + 1 < argc) {
+      b.w = strtold(argv[++i], NULL);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--every") && i + 1 < argc) {
+      every = atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+      output = argv[++i];
+    } else if (!strcmp(argv[i], "--arrow") && i + 1 < argc) {
+      arrow_path = argv[++i];
+    }
+  }
+
+  if (every <= 0 || tolerance < 0) {
+    printf("--every and --tolerance must be positive\n");
+    return 1;
+  }
+
+  RunOutput out = {.text = stdout, .e0 = getKinetic(&a, &b) +
+                                         getPotential(&a, &b)};
+  if (arrow_path) {
+    out.arrow = arrowOpen(arrow_path, N_COLS, columns, types);
+    if (out.arrow == NULL) {
+      printf("Could not open %s\n", arrow_path);
+      return 1;
+    }
+  } else if (output) {
+    out.text = fopen(output, "w");
+    if (out.text == NULL) {
+      printf("Could not open %s\n", output);
+      return 1;
+    }
+  }
+  if (!out.arrow) {
+    fprintf(out.text, "time,theta1,theta2,omega1,omega2,energy\n");
+  }
+
+  out.chunk = budgetFit(RUN_CHUNK, N_COLS * sizeof(double), 0.5);
+  for (int c = 0; c < N_COLS; c++) {
+    out.cols[c] = budgetAlloc(MEM_BUFFERS, out.chunk * sizeof(double));
+    if (out.cols[c] == NULL) {
+      printf("Could not allocate output buffers\n");
+      return 1;
+    }
+  }
+
+  long steps = (long)(seconds / DT);
+  long stepped = 0;
+  int err = 0;
+  if (tolerance > 0) {
+    /* Rows stay exact steps; the dense output's midpoint of each step is
+     * only a probe, so a swing between two steps still counts */
+    double start[2] = {a.t, b.t};
+    Sampler sampler;
+    samplerInit(&sampler, tolerance, start);
+    err = addRow(&out, 0, &a, &b);
+    for (long s = 1; s <= steps && !err; s++) {
+      Body pa = a, pb = b;
+      updatePositions(&a, &b);
+      countSteps(++stepped);
+      double mid[2] = {hermite(pa.t, pa.w, a.t, a.w, DT, 0.5),
+                       hermite(pb.t, pb.w, b.t, b.w, DT, 0.5)};
+      double end[2] = {a.t, b.t};
+      int kept = samplerPush(&sampler, mid, 1);
+      kept |= samplerPush(&sampler, end, 0);
+      if (kept) {
+        err = addRow(&out, (s - 1) * DT, &pa, &pb);
+      }
+      if (s == steps && !err) {
+        err = addRow(&out, s * DT, &a, &b);
+      }
+    }
+  }
+  for (long s = 0; s <= steps && !err && tolerance == 0; s++) {
+    if (s % every == 0) {
+      err = addRow(&out, s * DT, &a, &b);
+    }
+    updatePositions(&a, &b);
+    countSteps(++stepped);
+  }
+  metricsAdd(COUNTER_STEPS, stepped % COUNT_STEPS);
+  metricsAdd(COUNTER_LAGRANGE, 4 * (stepped % COUNT_STEPS));
+  if (out.rows > 0 && !err) {
+    err = flush(&out);
+  }
+
+  if (out.arrow) {
+    err |= arrowClose(out.arrow);
+  } else if (out.text != stdout) {
+    err |= fclose(out.text) != 0;
+  }
+  if (err) {
+    printf("Error writing trajectory\n");
+  }
+
+  for (int c = 0; c < N_COLS; c++) {
+    budgetFree(out.cols[c]);
+  }
+  return err;
+}
@@ -0,0 +1,8 @@
+#ifndef RUN_H
+#define RUN_H
+
+/* double-pendulum --run: integrate one pendulum without a window and write
+ * its trajectory as CSV or Arrow */
+int runMain(int argc, char **argv);
+
+#endif
@@ -0,0 +1,61 @@
+#include "sample.h"
+
+#include <string.h>
+
+/* Squared distance from q to the segment a b */
+static double distance2(const double *a, const double *b, const double *q) {
+  double ab = 0, aq = 0;
+  for (int d = 0; d < SAMPLE_DIMS; d++) {
+    ab += (b[d] - a[d]) * (b[d] - a[d]);
+    aq += (b[d] - a[d]) * (q[d] - a[d]);
+  }
+  double u = ab > 0 ? aq / ab : 0;
+  u = u < 0 ? 0 : u > 1 ? 1 : u;
+
+  double r = 0;
+  for (int d = 0; d < SAMPLE_DIMS; d++) {
+    double x = a[d] + u * (b[d] - a[d]) - q[d];
+    r += x * x;
+  }
+  return r;
+}
+
+static int fits(const Sampler *s, const double *p) {
+  for (int k = 0; k < s->n; k++) {
+    if (distance2(s->anchor, p, s->points[k]) > s->tol * s->tol) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void samplerInit(Sampler *s, double tol, const double *start) {
+  s->tol = tol;
+  memcpy(s->anchor, start, sizeof(s->anchor));
+  s->n = 0;
+  s->last = -1;
+}
+
+int samplerPush(Sampler *s, const double *p, int probe) {
+  int kept = 0;
+  if (s->n == SAMPLE_PENDING || !fits(s, p)) {
+    if (s->last >= 0) {
+      /* Re-anchor there, keeping the probes after it */
+      memcpy(s->anchor, s->points[s->last], sizeof(s->anchor));
+      s->n -= s->last + 1;
+      memmove(s->points, s->points + s->last + 1, s->n * sizeof(s->points[0]));
+      s->last = -1;
+      kept = 1;
+    }
+    if (s->n == SAMPLE_PENDING) {
+      s->n = 0;
+    }
+  }
+
+  memcpy(s->points[s->n], p, sizeof(s->points[0]));
+  if (!probe) {
+    s->last = s->n;
+  }
+  s->n++;
+  return kept;
+}
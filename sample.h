@@ -0,0 +1,36 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#define SAMPLE_DIMS 2     // Coordinates per point
+#define SAMPLE_PENDING 64 // Points held back before one is kept regardless
+
+/* Thins a path as it's produced: a point is only kept once the straight
+ * line from the last kept point can no longer pass within tol of every
+ * point since. Smooth stretches collapse to a few points while tight swings
+ * keep as many as they need. */
+typedef struct Sampler {
+  double tol;
+  double anchor[SAMPLE_DIMS]; // Last point kept
+  double points[SAMPLE_PENDING][SAMPLE_DIMS]; // Since the anchor, in order
+  int n;
+  int last; // Newest of points that may be kept, -1 if none
+} Sampler;
+
+/* Start a path at start, which counts as kept */
+void samplerInit(Sampler *s, double tol, const double *start);
+
+/* Add the next point. Probes only test the line and are never kept, for
+ * points that exist only through interpolation. Returns 1 if the newest
+ * keepable point before p had to be kept, which is then in s->anchor. */
+int samplerPush(Sampler *s, const double *p, int probe);
+
+/* Dense output of an RK4 step: the cubic Hermite interpolant of an angle
+ * going from x0 with rate w0 to x1 with rate w1 over dt, at fraction u */
+static inline double hermite(double x0, double w0, double x1, double w1,
+                             double dt, double u) {
+  double u2 = u * u, u3 = u2 * u;
+  return (2 * u3 - 3 * u2 + 1) * x0 + (u3 - 2 * u2 + u) * dt * w0 +
+         (3 * u2 - 2 * u3) * x1 + (u3 - u2) * dt * w1;
+}
+
+#endif
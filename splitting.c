@@ -0,0 +1,394 @@
+#define _GNU_SOURCE
+#include "splitting.h"
+#include "ensemble.h"
+#include "rng.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLAB 1024 // Particles per pool allocation
+
+void splittingDefaults(SplittingConfig *cfg) {
+  cfg->theta1 = 0;
+  cfg->theta2 = 0;
+  cfg->seconds = 20.0;
+  cfg->gamma = 0.5;
+  cfg->kT = 1.5;
+  cfg->particles = 4096;
+  cfg->keep = 0.2;
+  cfg->max_stages = 64;
+  cfg->runs = 4;
+  cfg->seed = 1;
+  cfg->threads = 0;
+}
+
+/* A particle's state at the moment it crossed a level */
+typedef struct Particle {
+  double t1, t2, w1, w2;
+  long step;
+  struct Particle *next;
+} Particle;
+
+/* Fixed-size free-list allocator, so cloning and pruning thousands of
+ * particles per stage never goes back to malloc after the first stages */
+typedef struct ParticlePool {
+  Particle *free;
+  void **slabs;
+  int n_slabs;
+} ParticlePool;
+
+static Particle *particleAlloc(ParticlePool *pool) {
+  if (pool->free == NULL) {
+    Particle *slab = malloc(SLAB * sizeof(Particle));
+    void **slabs = realloc(pool->slabs, (pool->n_slabs + 1) * sizeof(void *));
+    if (slab == NULL || slabs == NULL) {
+      free(slab);
+      return NULL;
+    }
+    pool->slabs = slabs;
+    pool->slabs[pool->n_slabs++] = slab;
+    for (int i = 0; i < SLAB; i++) {
+      slab[i].next = pool->free;
+      pool->free = &slab[i];
+    }
+  }
+
+  Particle *p = pool->free;
+  pool->free = p->next;
+  return p;
+}
+
+static void particleFree(ParticlePool *pool, Particle *p) {
+  p->next = pool->free;
+  pool->free = p;
+}
+
+static void particlePoolDestroy(ParticlePool *pool) {
+  for (int i = 0; i < pool->n_slabs; i++) {
+    free(pool->slabs[i]);
+  }
+  free(pool->slabs);
+}
+
+/* Finite sentinels, since -Ofast assumes there are no infinities or NANs */
+#define FLIPPED DBL_MAX
+#define UNSCORED (-DBL_MAX)
+
+typedef struct StageJob {
+  const Ensemble *e;
+  uint64_t seed;
+  long total_steps;
+  const long *start;
+  double *score; // Highest energy reached, FLIPPED on a flip
+  int capture;   // Second pass: stop particles where they cross level
+  double level;
+  Particle *const *captured;
+  double *energy;
+  long long steps;
+} StageJob;
+
+static void stageTask(void *ctx, size_t begin, size_t end) {
+  StageJob *job = ctx;
+  const Ensemble *e = job->e;
+  int capture = job->capture;
+  long long steps = 0;
+
+  for (size_t i = begin; i < end; i++) {
+    job->score[i] = UNSCORED;
+  }
+
+  for (long s = 0;; s++) {
+    size_t live = 0;
+    ensembleLangevinRange(e, DT, job->seed, s, begin, end);
+    ensembleEnergy(e, begin, end, job->energy);
+
+    for (size_t i = begin; i < end; i++) {
+      if (job->score[i] == FLIPPED || job->start[i] + s >= job->total_steps ||
+          (capture && job->score[i] >= job->level)) {
+        continue;
+      }
+      steps++;
+
+      if (fabs(e->t1[i]) > M_PI || fabs(e->t2[i]) > M_PI) {
+        job->score[i] = FLIPPED;
+      } else if (job->energy[i] > job->score[i]) {
+        job->score[i] = job->energy[i];
+      }
+
+      if (capture && job->score[i] >= job->level) {
+        Particle *p = job->captured[i];
+        p->t1 = e->t1[i];
+        p->t2 = e->t2[i];
+        p->w1 = e->w1[i];
+        p->w2 = e->w2[i];
+        p->step = job->start[i] + s + 1;
+      } else {
+        live++;
+      }
+    }
+
+    if (live == 0) {
+      break;
+    }
+  }
+
+  __atomic_fetch_add(&job->steps, steps, __ATOMIC_RELAXED);
+}
+
+static int compareDouble(const void *x, const void *y) {
+  double a = *(const double *)x, b = *(const double *)y;
+  return (a > b) - (a < b);
+}
+
+int runSplitting(const SplittingConfig *cfg, uint64_t seed,
+                 SplittingResult *result) {
+  size_t n = cfg->particles;
+  Body a = {.l = 1.0, .m = 1.0, .t = cfg->theta1};
+  Body b = {.l = 1.0, .m = 1.0, .t = cfg->theta2};
+
+  Ensemble e = {0};
+  ParticlePool particles = {0};
+  Pool *pool = poolCreate(cfg->threads);
+  Particle **entrance = calloc(n, sizeof(Particle *));
+  Particle **captured = calloc(n, sizeof(Particle *));
+  Particle **keep = malloc(n * sizeof(Particle *));
+  long *start = calloc(n, sizeof(long));
+  double *score = malloc(n * sizeof(double));
+  double *sorted = malloc(n * sizeof(double));
+  double *energy = malloc(n * sizeof(double));
+  double *pick = malloc(n * sizeof(double));
+  double *unused = malloc(n * sizeof(double));
+  int err = 1;
+
+  if (!pool || !entrance || !captured || !keep || !start || !score ||
+      !sorted || !energy || !pick || !unused ||
+      ensembleInit(&e, n, &a, &b) != 0) {
+    printf("Could not allocate %zu particles\n", n);
+    goto done;
+  }
+  e.gamma = cfg->gamma;
+  e.kT = cfg->kT;
+
+  for (size_t i = 0; i < n; i++) {
+    entrance[i] = particleAlloc(&particles);
+    captured[i] = particleAlloc(&particles);
+    if (!entrance[i] || !captured[i]) {
+      printf("Could not allocate %zu particles\n", n);
+      goto done;
+    }
+    *entrance[i] = (Particle){.t1 = a.t, .t2 = b.t, .w1 = 0, .w2 = 0};
+  }
+
+  memset(result, 0, sizeof(*result));
+  result->p = 1;
+
+  StageJob job = {.e = &e,
+                  .total_steps = (long)(cfg->seconds / DT),
+                  .start = start,
+                  .score = score,
+                  .captured = captured,
+                  .energy = energy};
+
+  for (int stage = 0; stage < cfg->max_stages; stage++) {
+    job.seed = seed + (stage + 1) * 0x9E3779B97F4A7C15ULL;
+
+    /* First pass: how far does each particle get? */
+    for (size_t i = 0; i < n; i++) {
+      e.t1[i] = entrance[i]->t1;
+      e.t2[i] = entrance[i]->t2;
+      e.w1[i] = entrance[i]->w1;
+      e.w2[i] = entrance[i]->w2;
+      start[i] = entrance[i]->step;
+    }
+    job.capture = 0;
+    poolRun(pool, stageTask, &job, n, ENSEMBLE_BLOCK);
+
+    memcpy(sorted, score, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compareDouble);
+    size_t flips = 0;
+    while (flips < n && sorted[n - 1 - flips] == FLIPPED) {
+      flips++;
+    }
+
+    /* Out of stages, the flips from the last level still count, but the
+     * estimate has more variance than the run was set up for */
+    result->stages = stage + 1;
+    size_t survivors = (size_t)(cfg->keep * n);
+    if (flips >= survivors || survivors == 0 ||
+        stage + 1 == cfg->max_stages) {
+      result->p *= (double)flips / n;
+      result->converged = flips >= survivors;
+      break;
+    }
+
+    /* Next level where only a fraction keep get through. Ties at the level
+     * all survive, so count them rather than assuming keep. */
+    double level = sorted[n - survivors];
+    size_t crossed = 0;
+    for (size_t i = 0; i < n; i++) {
+      crossed += score[i] >= level;
+    }
+    if (level == sorted[0]) {
+      /* No progress at all, nothing to split on. The product so far is
+       * only an upper bound. */
+      result->stuck = 1;
+      break;
+    }
+    result->p *= (double)crossed / n;
+
+    /* Second pass: replay the same noise (the RNG is keyed by lane and
+     * step) and stop each survivor where it first crosses the level */
+    for (size_t i = 0; i < n; i++) {
+      e.t1[i] = entrance[i]->t1;
+      e.t2[i] = entrance[i]->t2;
+      e.w1[i] = entrance[i]->w1;
+      e.w2[i] = entrance[i]->w2;
+    }
+    job.capture = 1;
+    job.level = level;
+    poolRun(pool, stageTask, &job, n, ENSEMBLE_BLOCK);
+
+    /* Clone survivors into the next stage's entrance states */
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (score[i] >= level) {
+        keep[k++] = captured[i];
+      }
+      particleFree(&particles, entrance[i]);
+    }
+
+    philoxUniforms(seed, 0, stage, n, pick, unused);
+    for (size_t i = 0; i < n; i++) {
+      Particle *src = i < k ? keep[i] : keep[(size_t)(pick[i] * k)];
+      entrance[i] = particleAlloc(&particles);
+      if (entrance[i] == NULL) {
+        printf("Ran out of memory cloning particles\n");
+        goto done;
+      }
+      *entrance[i] = *src;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      if (score[i] < level) {
+        continue;
+      }
+      /* Hand the cloned-from state back and give the lane a fresh one */
+      particleFree(&particles, captured[i]);
+      captured[i] = particleAlloc(&particles);
+      if (captured[i] == NULL) {
+        printf("Ran out of memory cloning particles\n");
+        goto done;
+      }
+    }
+  }
+  result->steps = job.steps;
+  err = 0;
+
+done:
+  /* Particles live in the pool's slabs, so those go in one */
+  ensembleFree(&e);
+  poolDestroy(pool);
+  particlePoolDestroy(&particles);
+  free(entrance);
+  free(captured);
+  free(keep);
+  free(start);
+  free(score);
+  free(sorted);
+  free(energy);
+  free(pick);
+  free(unused);
+  return err;
+}
+
+/* double-pendulum --splitting [--theta1 T1] [--theta2 T2] [--seconds T]
+ *     [--gamma GAMMA] [--kT KT] [--particles N] [--keep F] [--runs R]
+ *     [--max-stages S] [--seed SEED] [--threads T] */
+int splittingMain(int argc, char **argv) {
+  SplittingConfig cfg;
+  splittingDefaults(&cfg);
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--theta1") && i + 1 < argc) {
+      cfg.theta1 = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--theta2") && i + 1 < argc) {
+      cfg.theta2 = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      cfg.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--gamma") && i + 1 < argc) {
+      cfg.gamma = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--kT") && i + 1 < argc) {
+      cfg.kT = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--particles") && i + 1 < argc) {
+      cfg.particles = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--keep") && i + 1 < argc) {
+      cfg.keep = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+      cfg.runs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-stages") && i + 1 < argc) {
+      cfg.max_stages = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      cfg.seed = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      cfg.threads = atoi(argv[++i]);
+    }
+  }
+
+  if (cfg.particles == 0 || cfg.keep <= 0 || cfg.keep >= 1 || cfg.runs <= 0 ||
+      cfg.max_stages <= 0) {
+    printf("Need particles > 0, 0 < keep < 1, runs > 0 and max-stages > 0\n");
+    return 1;
+  }
+
+  double sum = 0, sum2 = 0;
+  long long steps = 0;
+  int unconverged = 0, stuck = 0;
+  for (int r = 0; r < cfg.runs; r++) {
+    SplittingResult result;
+    if (runSplitting(&cfg, cfg.seed + r * 0x632BE59BD9B4E019ULL, &result)) {
+      return 1;
+    }
+    const char *note = "";
+    if (result.stuck) {
+      note = " (stuck, an upper bound)";
+    } else if (!result.converged) {
+      note = " (ran out of stages)";
+    }
+    printf("run %d: p = %.4e after %d stages, %lld steps%s\n", r + 1,
+           result.p, result.stages, result.steps, note);
+    stuck += result.stuck;
+    unconverged += !result.converged && !result.stuck;
+    sum += result.p;
+    sum2 += result.p * result.p;
+    steps += result.steps;
+  }
+
+  double mean = sum / cfg.runs;
+  double err = cfg.runs > 1 ? sqrt(fmax(0, (sum2 - sum * mean) /
+                                                (cfg.runs - 1) / cfg.runs))
+                            : 0;
+  printf("\nP(flip before %.2f s) = %.4e +- %.2e\n", cfg.seconds, mean, err);
+  if (unconverged) {
+    printf("%d of %d runs ran out of stages before a fraction keep flipped, "
+           "raise --max-stages\n",
+           unconverged, cfg.runs);
+  }
+  if (stuck) {
+    printf("%d of %d runs stopped with every particle at the same level, "
+           "raise --kT\n",
+           stuck, cfg.runs);
+  }
+
+  /* Plain sampling needs (1 - p) / (p rel^2) trajectories for the same
+   * relative error, each integrated for the whole of T */
+  if (mean > 0 && err > 0) {
+    double rel = err / mean;
+    double naive = (1 - mean) / (mean * rel * rel) * (cfg.seconds / DT);
+    printf("%lld steps, plain sampling would need about %.2e\n", steps,
+           naive);
+  }
+  return 0;
+}
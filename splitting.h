@@ -0,0 +1,39 @@
+#ifndef SPLITTING_H
+#define SPLITTING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Adaptive multilevel splitting for P(flip before T) of a Langevin
+ * ensemble started at rest. Each stage runs n particles until they flip or
+ * run out of time, puts the next energy level at the quantile only a
+ * fraction keep of them reach, clones the states where those particles
+ * first crossed it and prunes the rest. */
+typedef struct SplittingConfig {
+  double theta1, theta2;
+  double seconds;
+  double gamma, kT;
+  size_t particles;
+  double keep;    // Fraction of particles to clone at each level
+  int max_stages;
+  int runs;       // Independent repetitions, for the error estimate
+  uint64_t seed;
+  int threads;
+} SplittingConfig;
+
+typedef struct SplittingResult {
+  double p;
+  int stages;
+  int converged;   // 0 if max_stages ran out before keep of them flipped
+  int stuck;       // No particle got further than the rest, so p is only
+                   // an upper bound
+  long long steps; // Pendulum steps integrated
+} SplittingResult;
+
+void splittingDefaults(SplittingConfig *cfg);
+int runSplitting(const SplittingConfig *cfg, uint64_t seed,
+                 SplittingResult *result);
+
+int splittingMain(int argc, char **argv);
+
+#endif
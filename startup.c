@@ -0,0 +1,78 @@
+#include "startup.h"
+#include "clock.h"
+
+#include <stdio.h>
+
+void startupBegin(Startup *s) {
+  s->begin = s->last = nowSeconds();
+  s->n = 0;
+}
+
+void startupMark(Startup *s, const char *name) {
+  double now = nowSeconds();
+  if (s->n < STARTUP_PHASES) {
+    s->names[s->n] = name;
+    s->phases[s->n++] = now - s->last;
+  }
+  s->last = now;
+}
+
+void startupReport(const Startup *s) {
+  printf("First frame after %.1f ms:", (s->last - s->begin) * 1e3);
+  for (int i = 0; i < s->n; i++) {
+    printf(" %s %.1f%s", s->names[i], s->phases[i] * 1e3,
+           i + 1 < s->n ? "," : " ms\n");
+  }
+}
+
+static void *deferredThread(void *arg) {
+  Deferred *d = arg;
+  double start = nowSeconds();
+  if (historyInit(&d->history, d->e->n, d->capacity, d->interval)) {
+    d->error = "Could not allocate the snapshots for rewinding";
+  } else if (seekInit(&d->seek, d->e)) {
+    historyFree(&d->history);
+    d->error = "Could not allocate the copy for rewinding";
+  } else if (previewInit(&d->preview, d->e)) {
+    seekFree(&d->seek);
+    historyFree(&d->history);
+    d->error = "Could not start the preview thread";
+  }
+  d->seconds = nowSeconds() - start;
+  __atomic_store_n(&d->ready, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+int deferredStart(Deferred *d, const Ensemble *e, int capacity,
+                  long interval) {
+  d->e = e;
+  d->capacity = capacity;
+  d->interval = interval;
+  d->error = NULL;
+  d->ready = 0;
+  d->joined = 0;
+  return pthread_create(&d->thread, NULL, deferredThread, d) != 0;
+}
+
+int deferredReady(Deferred *d) {
+  if (!d->joined) {
+    if (!__atomic_load_n(&d->ready, __ATOMIC_ACQUIRE)) {
+      return 0;
+    }
+    pthread_join(d->thread, NULL);
+    d->joined = 1;
+  }
+  return d->error ? -1 : 1;
+}
+
+void deferredFree(Deferred *d) {
+  if (!d->joined) {
+    pthread_join(d->thread, NULL);
+    d->joined = 1;
+  }
+  if (d->error == NULL) {
+    previewFree(&d->preview);
+    seekFree(&d->seek);
+    historyFree(&d->history);
+  }
+}
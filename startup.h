@@ -0,0 +1,56 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <pthread.h>
+
+#include "ensemble.h"
+#include "history.h"
+#include "preview.h"
+
+#define STARTUP_PHASES 8
+
+/* Time from entering main() to the first frame, split at each mark */
+typedef struct Startup {
+  double begin, last;
+  const char *names[STARTUP_PHASES];
+  double phases[STARTUP_PHASES];
+  int n;
+} Startup;
+
+void startupBegin(Startup *s);
+
+/* End the phase called name, which must outlive s */
+void startupMark(Startup *s, const char *name);
+
+/* Print the total so far and each phase */
+void startupReport(const Startup *s);
+
+/* Rewinding and the drag preview, which the first frame can do without.
+ * Their snapshot buffers, seek copy and worker thread are set up on a
+ * background thread. It only reads e's size and parameters, so e can be
+ * stepped meanwhile, and its first snapshot is up to the caller once
+ * deferredReady() says so. */
+typedef struct Deferred {
+  History history;
+  Seek seek;
+  Preview preview;
+  const Ensemble *e;
+  int capacity;
+  long interval;
+  const char *error; // What failed, if anything
+  int ready;         // Written by the thread once the rest is set
+  int joined;
+  double seconds; // Taken by the thread
+  pthread_t thread;
+} Deferred;
+
+int deferredStart(Deferred *d, const Ensemble *e, int capacity,
+                  long interval);
+
+/* 1 once everything is usable, -1 if it failed with d->error, else 0 */
+int deferredReady(Deferred *d);
+
+/* Wait for the thread and free whatever it set up */
+void deferredFree(Deferred *d);
+
+#endif
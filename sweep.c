@@ -0,0 +1,385 @@
+#define _GNU_SOURCE
+#include "sweep.h"
+#include "arrow.h"
+#include "budget.h"
+#include "ensemble.h"
+#include "image.h"
+#include "metrics.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TILE_LANES 65536 // Cells integrated per tile, roughly
+#define CSV_ROW_BYTES 104 // Longest row the CSV format can produce
+
+typedef struct FlipJob {
+  const Ensemble *e;
+  long steps;
+  double *flip_time;
+} FlipJob;
+
+static void flipTask(void *ctx, size_t begin, size_t end) {
+  FlipJob *job = ctx;
+  const Ensemble *e = job->e;
+  size_t left = end - begin;
+
+  /* 0 until flipped: NAN can't be tested for under -Ofast */
+  for (size_t i = begin; i < end; i++) {
+    job->flip_time[i] = 0;
+  }
+
+  /* A chunk stops as soon as all of its cells have flipped */
+  for (long s = 0; s < job->steps && left > 0; s++) {
+    ensembleStepRange(e, DT, begin, end);
+    for (size_t i = begin; i < end; i++) {
+      if (job->flip_time[i] == 0 &&
+          (fabs(e->t1[i]) > M_PI || fabs(e->t2[i]) > M_PI)) {
+        job->flip_time[i] = (s + 1) * DT;
+        left--;
+      }
+    }
+  }
+}
+
+void sweepFlipTimes(Ensemble *e, Pool *pool, double seconds,
+                    double *flip_time) {
+  FlipJob job = {.e = e, .steps = (long)(seconds / DT), .flip_time = flip_time};
+  poolRun(pool, flipTask, &job, e->n, ENSEMBLE_BLOCK);
+}
+
+typedef struct SweepRun {
+  const SweepConfig *cfg;
+  SweepSink encode, write;
+  void *ctx;
+  Ensemble e;
+  Pool *pool;
+  int tile_rows;
+  int next_row;
+} SweepRun;
+
+static int stepStage(void *ctx, PipeItem *item) {
+  SweepRun *run = ctx;
+  SweepTile *tile = item->data;
+  const SweepConfig *cfg = run->cfg;
+  int row = run->next_row;
+
+  tile->slot = item->slot;
+  tile->row = row;
+  tile->rows = row + run->tile_rows <= cfg->height ? run->tile_rows
+                                                   : cfg->height - row;
+  tile->n = (size_t)tile->rows * cfg->width;
+  run->e.n = tile->n;
+
+  for (size_t i = 0; i < tile->n; i++) {
+    int x = i % cfg->width, y = row + i / cfg->width;
+    tile->theta1[i] = -M_PI + (x + 0.5) * 2 * M_PI / cfg->width;
+    tile->theta2[i] = M_PI - (y + 0.5) * 2 * M_PI / cfg->height;
+    run->e.t1[i] = tile->theta1[i];
+    run->e.t2[i] = tile->theta2[i];
+    run->e.w1[i] = 0;
+    run->e.w2[i] = 0;
+  }
+  ensembleEnergy(&run->e, 0, tile->n, tile->energy);
+  sweepFlipTimes(&run->e, run->pool, cfg->seconds, tile->flip_time);
+
+  run->next_row += tile->rows;
+  item->last = run->next_row >= cfg->height;
+  item->bytes = tile->n * 4 * sizeof(double);
+  return 0;
+}
+
+static int analyzeStage(void *ctx, PipeItem *item) {
+  (void)ctx;
+  SweepTile *tile = item->data;
+  tile->flipped = 0;
+  for (size_t i = 0; i < tile->n; i++) {
+    if (tile->flip_time[i] == 0) {
+      tile->flip_time[i] = NAN;
+    } else {
+      tile->flipped++;
+    }
+  }
+  return 0;
+}
+
+static int encodeStage(void *ctx, PipeItem *item) {
+  SweepRun *run = ctx;
+  SweepTile *tile = item->data;
+  tile->bytes = 0;
+  int err = run->encode ? run->encode(tile, run->ctx) : 0;
+  item->bytes = tile->bytes;
+  return err;
+}
+
+static int writeStage(void *ctx, PipeItem *item) {
+  SweepRun *run = ctx;
+  SweepTile *tile = item->data;
+  tile->bytes = 0;
+  int err = run->write ? run->write(tile, run->ctx) : 0;
+  item->bytes = tile->bytes;
+  metricsAdd(COUNTER_TILES, 1);
+  metricsAdd(COUNTER_BYTES, tile->bytes);
+  return err;
+}
+
+int runSweep(const SweepConfig *cfg, SweepSink encode, SweepSink write,
+             void *ctx, Pipeline *pipe) {
+  SweepRun run = {.cfg = cfg, .encode = encode, .write = write, .ctx = ctx};
+  run.tile_rows = TILE_LANES / cfg->width;
+  if (run.tile_rows < 1) {
+    run.tile_rows = 1;
+  }
+  size_t cap = (size_t)run.tile_rows * cfg->width;
+  int n_tiles = cfg->tiles > 0 ? cfg->tiles : SWEEP_TILES;
+
+  Body a = {.l = 1.0, .m = 1.0};
+  Body b = {.l = 1.0, .m = 1.0};
+
+  run.pool = poolCreate(cfg->threads);
+  SweepTile *tiles = calloc(n_tiles, sizeof(SweepTile));
+  void **buffers = malloc(n_tiles * sizeof(void *));
+  int err = !run.pool || !tiles || !buffers ||
+            ensembleInit(&run.e, cap, &a, &b) != 0;
+  for (int k = 0; k < n_tiles && !err; k++) {
+    tiles[k].theta1 = budgetAlloc(MEM_TILES, cap * sizeof(double));
+    tiles[k].theta2 = budgetAlloc(MEM_TILES, cap * sizeof(double));
+    tiles[k].flip_time = budgetAlloc(MEM_TILES, cap * sizeof(double));
+    tiles[k].energy = budgetAlloc(MEM_TILES, cap * sizeof(double));
+    buffers[k] = &tiles[k];
+    err = !tiles[k].theta1 || !tiles[k].theta2 || !tiles[k].flip_time ||
+          !tiles[k].energy;
+  }
+  if (err) {
+    printf("Could not allocate %d tiles of %zu cells\n", n_tiles, cap);
+    goto done;
+  }
+
+  pipelineInit(pipe);
+  pipelineStage(pipe, "step", stepStage, &run);
+  pipelineStage(pipe, "analyze", analyzeStage, &run);
+  pipelineStage(pipe, "encode", encodeStage, &run);
+  pipelineStage(pipe, "write", writeStage, &run);
+  err = pipelineRun(pipe, buffers, n_tiles);
+
+done:
+  ensembleFree(&run.e);
+  poolDestroy(run.pool);
+  for (int k = 0; tiles && k < n_tiles; k++) {
+    budgetFree(tiles[k].theta1);
+    budgetFree(tiles[k].theta2);
+    budgetFree(tiles[k].flip_time);
+    budgetFree(tiles[k].energy);
+  }
+  free(tiles);
+  free(buffers);
+  return err;
+}
+
+enum { COL_T1, COL_T2, COL_FLIP, COL_ENERGY, N_COLS };
+
+static const char *const columns[N_COLS] = {"theta1", "theta2", "flip_time",
+                                            "energy"};
+static const ArrowType types[N_COLS] = {ARROW_FLOAT64, ARROW_FLOAT64,
+                                        ARROW_FLOAT64, ARROW_FLOAT64};
+
+typedef struct SweepOutput {
+  FILE *text;
+  ArrowWriter *arrow;
+  PngWriter *png;
+  int width;
+  double seconds;
+
+  /* CSV formatted by the encode stage, one buffer per tile in flight */
+  char **csv;
+  size_t *csv_len, *csv_cap;
+  size_t flipped;
+} SweepOutput;
+
+/* Colormap straight into a strip buffer for the PNG encoder threads and
+ * format the CSV, while the next tile integrates */
+static int encodeSink(SweepTile *tile, void *ctx) {
+  SweepOutput *out = ctx;
+
+  if (out->png) {
+    PngStrip *strip = pngStrip(out->png, tile->rows);
+    if (strip == NULL) {
+      return 1;
+    }
+    for (int r = 0; r < tile->rows; r++) {
+      colormapFlipTimes(tile->flip_time + (size_t)r * out->width, out->width,
+                        DT, out->seconds, pngRow(out->png, strip, r));
+    }
+    pngSubmit(out->png, strip);
+    tile->bytes += (size_t)tile->rows * out->width * 3;
+  }
+
+  if (out->text) {
+    int k = tile->slot;
+    if (out->csv_cap[k] < tile->n * CSV_ROW_BYTES) {
+      budgetFree(out->csv[k]);
+      out->csv_cap[k] = tile->n * CSV_ROW_BYTES;
+      out->csv[k] = budgetAlloc(MEM_BUFFERS, out->csv_cap[k]);
+      if (out->csv[k] == NULL) {
+        out->csv_cap[k] = 0;
+        return 1;
+      }
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < tile->n; i++) {
+      len += snprintf(out->csv[k] + len, out->csv_cap[k] - len,
+                      "%.17g,%.17g,%.9g,%.17g\n", tile->theta1[i],
+                      tile->theta2[i], tile->flip_time[i], tile->energy[i]);
+    }
+    out->csv_len[k] = len;
+    tile->bytes += len;
+  }
+  return 0;
+}
+
+static int writeSink(SweepTile *tile, void *ctx) {
+  SweepOutput *out = ctx;
+  int err = 0;
+  out->flipped += tile->flipped;
+
+  if (out->arrow) {
+    const void *cols[N_COLS] = {tile->theta1, tile->theta2, tile->flip_time,
+                                tile->energy};
+    err |= arrowWriteBatch(out->arrow, tile->n, cols);
+    tile->bytes += tile->n * N_COLS * sizeof(double);
+  }
+
+  if (out->text) {
+    size_t len = out->csv_len[tile->slot];
+    err |= fwrite(out->csv[tile->slot], 1, len, out->text) != len;
+    tile->bytes += len;
+  }
+  return err;
+}
+
+/* double-pendulum --sweep [--width W] [--height H] [--seconds T]
+ *     [--threads T] [--tiles N] [--output FILE] [--arrow FILE]
+ *     [--png FILE] [--encode-threads N] [--stats]
+ *
+ * CSV goes to stdout unless an Arrow or PNG file is asked for. --stats
+ * prints how busy each stage of the pipeline was, so it needs the output
+ * to go to files. */
+int sweepMain(int argc, char **argv) {
+  SweepConfig cfg = {.width = 256, .height = 256, .seconds = 10.0};
+  const char *output = NULL;
+  const char *arrow_path = NULL;
+  const char *png_path = NULL;
+  int encode_threads = 2;
+  int stats = 0;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--width") && i + 1 < argc) {
+      cfg.width = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--height") && i + 1 < argc) {
+      cfg.height = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      cfg.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      cfg.threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+      output = argv[++i];
+    } else if (!strcmp(argv[i], "--arrow") && i + 1 < argc) {
+      arrow_path = argv[++i];
+    } else if (!strcmp(argv[i], "--png") && i + 1 < argc) {
+      png_path = argv[++i];
+    } else if (!strcmp(argv[i], "--encode-threads") && i + 1 < argc) {
+      encode_threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--tiles") && i + 1 < argc) {
+      cfg.tiles = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--stats")) {
+      stats = 1;
+    }
+  }
+
+  if (cfg.width <= 0 || cfg.height <= 0) {
+    printf("Grid size must be positive\n");
+    return 1;
+  }
+  if (cfg.seconds <= DT) {
+    printf("--seconds must be longer than one step (%g)\n", DT);
+    return 1;
+  }
+  if (stats && !output && !arrow_path && !png_path) {
+    printf("--stats needs --output, --arrow or --png\n");
+    return 1;
+  }
+  int n_tiles = cfg.tiles > 0 ? cfg.tiles : SWEEP_TILES;
+
+  /* Fewer tiles in flight if they would not fit in memory */
+  int tile_rows = TILE_LANES / cfg.width > 0 ? TILE_LANES / cfg.width : 1;
+  size_t tile_cells = (size_t)tile_rows * cfg.width;
+  int text = output || (!arrow_path && !png_path);
+  size_t tile_bytes =
+      tile_cells * (4 * sizeof(double) + (text ? CSV_ROW_BYTES : 0));
+  n_tiles = cfg.tiles = budgetFit(n_tiles, tile_bytes, 0.5);
+
+  SweepOutput out = {.width = cfg.width, .seconds = cfg.seconds};
+  if (arrow_path) {
+    out.arrow = arrowOpen(arrow_path, N_COLS, columns, types);
+    if (out.arrow == NULL) {
+      printf("Could not open %s\n", arrow_path);
+      return 1;
+    }
+  }
+  if (png_path) {
+    out.png = pngOpen(png_path, cfg.width, cfg.height, encode_threads);
+    if (out.png == NULL) {
+      printf("Could not open %s\n", png_path);
+      return 1;
+    }
+  }
+  if (text) {
+    out.text = output ? fopen(output, "w") : stdout;
+    if (out.text == NULL) {
+      printf("Could not open %s\n", output);
+      return 1;
+    }
+    fprintf(out.text, "theta1,theta2,flip_time,energy\n");
+  }
+
+  out.csv = calloc(n_tiles, sizeof(char *));
+  out.csv_len = calloc(n_tiles, sizeof(size_t));
+  out.csv_cap = calloc(n_tiles, sizeof(size_t));
+  if (!out.csv || !out.csv_len || !out.csv_cap) {
+    printf("Could not allocate output buffers\n");
+    return 1;
+  }
+
+  Pipeline pipe;
+  pipelineInit(&pipe);
+  metricsWatch(&pipe);
+  int err = runSweep(&cfg, encodeSink, writeSink, &out, &pipe);
+  metricsWatch(NULL);
+
+  if (out.png) {
+    err |= pngClose(out.png);
+  }
+  if (out.arrow) {
+    err |= arrowClose(out.arrow);
+  }
+  if (out.text && out.text != stdout) {
+    err |= fclose(out.text) != 0;
+  }
+
+  if (err) {
+    printf("Sweep failed\n");
+  } else if (stats) {
+    printf("%.1f%% of cells flipped\n",
+           100.0 * out.flipped / ((size_t)cfg.width * cfg.height));
+    pipelineReport(&pipe, stdout);
+  }
+
+  for (int k = 0; k < n_tiles; k++) {
+    budgetFree(out.csv[k]);
+  }
+  free(out.csv);
+  free(out.csv_len);
+  free(out.csv_cap);
+  return err;
+}
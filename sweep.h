@@ -0,0 +1,52 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stddef.h>
+
+#include "ensemble.h"
+#include "pipeline.h"
+#include "pool.h"
+
+/* Flip-time map: every cell of a width x height grid over
+ * (theta1, theta2) in [-pi, pi)^2 starts at rest and is integrated until
+ * either segment passes over the top or the time runs out. */
+typedef struct SweepConfig {
+  int width, height;
+  double seconds;
+  int threads;
+  int tiles; // Tiles in flight between stages, 0 for SWEEP_TILES
+} SweepConfig;
+
+#define SWEEP_TILES 4
+
+/* Results for rows [row, row + rows) of the grid, one entry per cell in row
+ * major order. flip_time is NAN for cells that never flipped. */
+typedef struct SweepTile {
+  int row, rows;
+  size_t n;
+  int slot; // Which of the tiles in flight this is, for per-tile scratch
+  double *theta1, *theta2;
+  double *flip_time;
+  double *energy;
+  size_t flipped;
+  size_t bytes; // Output produced, set by sinks for the stage stats
+} SweepTile;
+
+/* Integrate every lane of e from its current state for up to seconds and
+ * record when either segment first passes over the top, 0 if it never does */
+void sweepFlipTimes(Ensemble *e, Pool *pool, double seconds,
+                    double *flip_time);
+
+typedef int (*SweepSink)(SweepTile *tile, void *ctx);
+
+/* Run the sweep a few rows at a time as a pipeline: step integrates a tile,
+ * analyze marks the cells that never flipped, then encode and write hand it
+ * to the caller. Each stage has a thread of its own, so integration only
+ * waits on output once every tile is queued behind it. Either sink may be
+ * NULL. Per-stage stats are left in pipe. */
+int runSweep(const SweepConfig *cfg, SweepSink encode, SweepSink write,
+             void *ctx, Pipeline *pipe);
+
+int sweepMain(int argc, char **argv);
+
+#endif
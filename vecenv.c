@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include "vecenv.h"
+#include "clock.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void vecEnvDefaults(VecEnvConfig *cfg) {
+  cfg->dt = DT;
+  cfg->substeps = 1;
+  cfg->max_steps = 500;
+  cfg->max_torque = 20.0;
+  cfg->max_velocity = 40.0;
+  cfg->torque_cost = 1e-3;
+  cfg->reset_noise = 0.2;
+  cfg->seed = 0;
+}
+
+/* splitmix64, so a lane's resets depend only on (seed, lane, episode) and
+ * not on which thread happens to run it */
+static unsigned long long mix(unsigned long long x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static double uniform(unsigned long long *state) {
+  *state = mix(*state);
+  return (*state >> 11) * (1.0 / 9007199254740992.0) * 2 - 1;
+}
+
+static void resetLane(VecEnv *env, size_t i) {
+  unsigned long long state =
+      mix(env->cfg.seed ^ mix(i) ^ mix(env->episodes[i]++ << 32));
+  env->ens.t1[i] = M_PI + env->cfg.reset_noise * uniform(&state);
+  env->ens.t2[i] = M_PI + env->cfg.reset_noise * uniform(&state);
+  env->ens.w1[i] = 0;
+  env->ens.w2[i] = 0;
+  env->steps[i] = 0;
+}
+
+static void observe(const VecEnv *env, size_t begin, size_t end, float *obs) {
+  const Ensemble *e = &env->ens;
+  for (size_t i = begin; i < end; i++) {
+    float *o = obs + i * VECENV_OBS;
+    o[0] = cos(e->t1[i]);
+    o[1] = sin(e->t1[i]);
+    o[2] = cos(e->t2[i]);
+    o[3] = sin(e->t2[i]);
+    o[4] = e->w1[i];
+    o[5] = e->w2[i];
+  }
+}
+
+VecEnv *vecEnvCreate(size_t n, const VecEnvConfig *cfg, int threads) {
+  VecEnv *env = calloc(1, sizeof(VecEnv));
+  if (env == NULL) {
+    return NULL;
+  }
+
+  Body a = {.l = 1.0, .m = 1.0};
+  Body b = {.l = 1.0, .m = 1.0};
+
+  env->n = n;
+  env->cfg = *cfg;
+  env->pool = poolCreate(threads);
+  env->u1 = calloc(n, sizeof(double));
+  env->u2 = calloc(n, sizeof(double));
+  env->steps = calloc(n, sizeof(int));
+  env->episodes = calloc(n, sizeof(unsigned long long));
+
+  if (!env->pool || !env->u1 || !env->u2 || !env->steps || !env->episodes ||
+      ensembleInit(&env->ens, n, &a, &b) != 0) {
+    vecEnvDestroy(env);
+    return NULL;
+  }
+
+  env->ens.u1 = env->u1;
+  env->ens.u2 = env->u2;
+  for (size_t i = 0; i < n; i++) {
+    resetLane(env, i);
+  }
+  return env;
+}
+
+void vecEnvDestroy(VecEnv *env) {
+  if (env == NULL) {
+    return;
+  }
+  ensembleFree(&env->ens);
+  poolDestroy(env->pool);
+  free(env->u1);
+  free(env->u2);
+  free(env->steps);
+  free(env->episodes);
+  free(env);
+}
+
+static void resetTask(void *ctx, size_t begin, size_t end) {
+  VecEnv *env = ctx;
+  for (size_t i = begin; i < end; i++) {
+    resetLane(env, i);
+  }
+  observe(env, begin, end, env->obs);
+}
+
+void vecEnvReset(VecEnv *env, float *obs) {
+  env->obs = obs;
+  poolRun(env->pool, resetTask, env, env->n, 4 * ENSEMBLE_BLOCK);
+}
+
+static void stepTask(void *ctx, size_t begin, size_t end) {
+  VecEnv *env = ctx;
+  const VecEnvConfig *cfg = &env->cfg;
+  Ensemble *e = &env->ens;
+
+  for (size_t i = begin; i < end; i++) {
+    double a1 = env->actions[i * VECENV_ACT];
+    double a2 = env->actions[i * VECENV_ACT + 1];
+    a1 = a1 < -1 ? -1 : a1 > 1 ? 1 : a1;
+    a2 = a2 < -1 ? -1 : a2 > 1 ? 1 : a2;
+    env->u1[i] = cfg->max_torque * a1;
+    env->u2[i] = cfg->max_torque * a2;
+    env->rewards[i] = -cfg->torque_cost * (a1 * a1 + a2 * a2);
+  }
+
+  for (int s = 0; s < cfg->substeps; s++) {
+    ensembleStepRange(e, cfg->dt, begin, end);
+  }
+
+  for (size_t i = begin; i < end; i++) {
+    /* 1 with both segments straight up, -1 hanging straight down */
+    env->rewards[i] += -0.5 * (cos(e->t1[i]) + cos(e->t2[i]));
+
+    int done = 0;
+    if (fabs(e->w1[i]) > cfg->max_velocity ||
+        fabs(e->w2[i]) > cfg->max_velocity) {
+      done = VECENV_TERMINATED;
+    } else if (++env->steps[i] >= cfg->max_steps) {
+      done = VECENV_TRUNCATED;
+    }
+    env->dones[i] = done;
+    if (done) {
+      if (env->final_obs) {
+        observe(env, i, i + 1, env->final_obs);
+      }
+      resetLane(env, i);
+    }
+  }
+
+  observe(env, begin, end, env->obs);
+}
+
+void vecEnvStep(VecEnv *env, const float *actions, float *obs,
+                float *final_obs, float *rewards, unsigned char *dones) {
+  env->actions = actions;
+  env->obs = obs;
+  env->final_obs = final_obs;
+  env->rewards = rewards;
+  env->dones = dones;
+  poolRun(env->pool, stepTask, env, env->n, 4 * ENSEMBLE_BLOCK);
+}
+
+/* double-pendulum --vecenv [--envs N] [--steps S] [--threads T]
+ *
+ * Steps N environments with random actions and reports throughput. */
+int vecEnvMain(int argc, char **argv) {
+  size_t n = 4096;
+  int steps = 1000;
+  int threads = 0;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--envs") && i + 1 < argc) {
+      n = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--steps") && i + 1 < argc) {
+      steps = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    }
+  }
+
+  VecEnvConfig cfg;
+  vecEnvDefaults(&cfg);
+
+  VecEnv *env = vecEnvCreate(n, &cfg, threads);
+  float *actions = malloc(n * VECENV_ACT * sizeof(float));
+  float *obs = malloc(n * VECENV_OBS * sizeof(float));
+  float *rewards = malloc(n * sizeof(float));
+  unsigned char *dones = malloc(n);
+  int err = 1;
+  if (!env || !actions || !obs || !rewards || !dones) {
+    printf("Could not allocate %zu environments\n", n);
+    goto done;
+  }
+
+  unsigned seed = 1;
+  for (size_t i = 0; i < n * VECENV_ACT; i++) {
+    actions[i] = 2.0 * rand_r(&seed) / RAND_MAX - 1;
+  }
+
+  vecEnvReset(env, obs);
+
+  long terminated = 0, truncated = 0;
+  double total_reward = 0;
+  double start = nowSeconds();
+  for (int s = 0; s < steps; s++) {
+    vecEnvStep(env, actions, obs, NULL, rewards, dones);
+    for (size_t i = 0; i < n; i++) {
+      terminated += dones[i] == VECENV_TERMINATED;
+      truncated += dones[i] == VECENV_TRUNCATED;
+      total_reward += rewards[i];
+    }
+  }
+  double elapsed = nowSeconds() - start;
+
+  printf("%zu envs x %d steps on %d threads: %.2f M env steps/s\n", n, steps,
+         env->pool->n_threads + 1, n * (double)steps / elapsed * 1e-6);
+  printf("%ld episodes terminated, %ld truncated, mean reward %.4f\n",
+         terminated, truncated, total_reward / ((double)n * steps));
+  err = 0;
+
+done:
+  vecEnvDestroy(env);
+  free(actions);
+  free(obs);
+  free(rewards);
+  free(dones);
+  return err;
+}
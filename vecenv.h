@@ -0,0 +1,69 @@
+#ifndef VECENV_H
+#define VECENV_H
+
+#include "ensemble.h"
+#include "pool.h"
+
+#include <stddef.h>
+
+#define VECENV_OBS 6 // cos t1, sin t1, cos t2, sin t2, w1, w2
+#define VECENV_ACT 2 // Torques on t1 and t2, in [-1, 1] of max_torque
+
+/* Why an episode ended. A terminated episode has no future reward, while a
+ * truncated one was only cut off at max_steps and should be bootstrapped
+ * from its final observation. Termination wins if both happen at once. */
+#define VECENV_TERMINATED 1 // Either |w| exceeded max_velocity
+#define VECENV_TRUNCATED 2  // Reached max_steps
+
+typedef struct VecEnvConfig {
+  double dt;
+  int substeps;        // Integrator steps per env step
+  int max_steps;       // Episode length before truncation
+  double max_torque;   // Torque for an action of 1 (N m)
+  double max_velocity; // Terminate when either |w| exceeds this
+  double torque_cost;  // Reward penalty per squared action
+  double reset_noise;  // Reset angles uniform in pi +- this
+  unsigned long long seed;
+} VecEnvConfig;
+
+/* N independent environments over one ensemble. Every call works on
+ * caller-owned buffers (e.g. numpy arrays passed through ctypes):
+ *   actions  N x VECENV_ACT floats
+ *   obs      N x VECENV_OBS floats
+ *   rewards  N floats
+ *   dones    N bytes, 0 or one of the VECENV_ values below
+ * Lanes that finish are reset in the same step, so obs holds the first
+ * observation of the next episode for them. Their last observation, which
+ * value bootstrapping on truncation needs, goes to the same row of
+ * final_obs (N x VECENV_OBS floats) if that is not NULL; other rows are
+ * left as they were. */
+typedef struct VecEnv {
+  size_t n;
+  VecEnvConfig cfg;
+  Ensemble ens;
+  Pool *pool;
+  double *u1, *u2;
+  int *steps;
+  unsigned long long *episodes;
+
+  /* Set per call */
+  const float *actions;
+  float *obs;
+  float *final_obs;
+  float *rewards;
+  unsigned char *dones;
+} VecEnv;
+
+void vecEnvDefaults(VecEnvConfig *cfg);
+
+/* threads counts the caller, 0 means one per cpu */
+VecEnv *vecEnvCreate(size_t n, const VecEnvConfig *cfg, int threads);
+void vecEnvDestroy(VecEnv *env);
+
+void vecEnvReset(VecEnv *env, float *obs);
+void vecEnvStep(VecEnv *env, const float *actions, float *obs,
+                float *final_obs, float *rewards, unsigned char *dones);
+
+int vecEnvMain(int argc, char **argv);
+
+#endif